@@ -0,0 +1,27 @@
+# Benchmark for the message decoders of the SensorHub application.
+# Build and run the benchmark with
+#
+#   qmake benchmark.pro && make && ./WeatherDataBenchmark
+#
+# Use -iterations <n> or -tickcounter to change the measurement of the QtTest benchmark.
+
+QT       += core testlib
+QT       -= gui
+
+TARGET = WeatherDataBenchmark
+TEMPLATE = app
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+        ../src/Widget/WeatherWidget/WeatherData/weatherdata.cpp \
+        weatherdatabenchmark.cpp
+
+HEADERS += \
+        ../src/Widget/WeatherWidget/WeatherData/weatherdata.h
+
+INCLUDEPATH += \
+        ../src/Widget/WeatherWidget/WeatherData \
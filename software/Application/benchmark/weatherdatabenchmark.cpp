@@ -0,0 +1,67 @@
+#include <QtTest>
+
+#include "weatherdata.h"
+
+/*
+ * Weather messages with all fields, as they are written by the firmware (Telemetry::WriteJSON and Telemetry::WriteCBOR)
+ * for the measurement used in SensorHub/Host/Benchmark/TelemetryBenchmark.cpp.
+ */
+static const char JSONMessage[] = "{\"Temperature\":21.37,\"Ambient light\":1234.50,\"UV\":3,\"Pressure\":1013.25,\"Humidity\":45.60,"
+                                  "\"Gas resistance\":125000,\"Gas valid\":true,\"IAQ\":57.30,\"IAQ valid\":true,\"Solar\":5.120,\"Battery\":3.970}";
+
+static const char CBORMessage[] = "\xab\x00\xfa\x41\xaa\xf5\xc3\x01\xfa\x44\x9a\x50\x00\x02\x03\x03\xfa\x44\x7d\x50\x00\x04\xfa\x42\x36\x66\x66"
+                                  "\x05\xfa\x47\xf4\x24\x00\x06\xf5\x07\xfa\x42\x65\x33\x33\x08\xf5\x09\xfa\x40\xa3\xd7\x0a\x0a\xfa\x40\x7e\x14\x7b";
+
+class WeatherDataBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private slots:
+        void initTestCase(void);
+        void readJSON(void);
+        void readCBOR(void);
+
+    private:
+        QByteArray _mJSON;
+        QByteArray _mCBOR;
+};
+
+void WeatherDataBenchmark::initTestCase(void)
+{
+    WeatherData JSON;
+    WeatherData CBOR;
+
+    this->_mJSON = QByteArray(JSONMessage, sizeof(JSONMessage) - 1);
+    this->_mCBOR = QByteArray(CBORMessage, sizeof(CBORMessage) - 1);
+
+    // Both messages must contain the same measurement, otherwise the decoders aren´t comparable
+    QVERIFY(JSON.readJSON(this->_mJSON));
+    QVERIFY(CBOR.readCBOR(this->_mCBOR));
+    QCOMPARE(CBOR.toCSV(), JSON.toCSV());
+
+    qDebug("JSON message: %d bytes, CBOR message: %d bytes", this->_mJSON.size(), this->_mCBOR.size());
+}
+
+void WeatherDataBenchmark::readJSON(void)
+{
+    WeatherData Data;
+
+    QBENCHMARK
+    {
+        Data.readJSON(this->_mJSON);
+    }
+}
+
+void WeatherDataBenchmark::readCBOR(void)
+{
+    WeatherData Data;
+
+    QBENCHMARK
+    {
+        Data.readCBOR(this->_mCBOR);
+    }
+}
+
+QTEST_APPLESS_MAIN(WeatherDataBenchmark)
+
+#include "weatherdatabenchmark.moc"
@@ -99,16 +99,24 @@ void ChartWidget::exportChart(void)
 
 void ChartWidget::AddDataPoint(double Value)
 {
-    QDateTime Now = QDateTime::currentDateTime();
+    this->AddDataPoint(Value, QDateTime::currentDateTime());
+}
+
+void ChartWidget::AddDataPoint(double Value, const QDateTime& Time)
+{
+    this->_mSeries->append(Time.toMSecsSinceEpoch(), Value);
 
-    qreal dx = this->_mChart->plotArea().width() / this->_mTime;
-    this->_mSeries->append(Now.toMSecsSinceEpoch(), Value);
-    this->_mChart->scroll(dx * (Now.toSecsSinceEpoch() - this->_mPrevious), 0);
+    // Points from a batch are older than the last point, so the chart is only scrolled for newer points
+    if(Time.toSecsSinceEpoch() > this->_mPrevious)
+    {
+        qreal dx = this->_mChart->plotArea().width() / this->_mTime;
+        this->_mChart->scroll(dx * (Time.toSecsSinceEpoch() - this->_mPrevious), 0);
+
+        this->_mPrevious = Time.toSecsSinceEpoch();
+    }
 
     if(_mSeries->count() > 600)
     {
         this->_mSeries->removePoints(0, this->_mSeries->count() - 600);
     }
-
-    this->_mPrevious = Now.toSecsSinceEpoch();
 }
@@ -27,6 +27,7 @@ class ChartWidget : public QChartView
         void setPen(QPen& Pen);
         void exportChart(void);
         void AddDataPoint(double Value);
+        void AddDataPoint(double Value, const QDateTime& Time);
 
     private:
         Ui::ChartWidget* _mUi;
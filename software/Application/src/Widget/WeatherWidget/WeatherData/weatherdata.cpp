@@ -1,5 +1,34 @@
+#include <QtEndian>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QCborStreamReader>
+
 #include "weatherdata.h"
 
+// Binary frame format of the SensorHub firmware (see Telemetry.h). The fields are also the keys of the CBOR map
+#define FRAME_VERSION               0x01
+#define FRAME_HEADER_SIZE           4
+#define FRAME_CRC_SIZE              2
+
+enum
+{
+    FIELD_TEMPERATURE = 0,
+    FIELD_AMBIENT_LIGHT,
+    FIELD_UV,
+    FIELD_PRESSURE,
+    FIELD_HUMIDITY,
+    FIELD_GAS_RESISTANCE,
+    FIELD_GAS_VALID,
+    FIELD_IAQ,
+    FIELD_IAQ_VALID,
+    FIELD_SOLAR,
+    FIELD_BATTERY,
+    FIELD_COUNT
+};
+
+// Size of each field in the frame. The validity flags are part of the header
+static const int FieldSize[FIELD_COUNT] = {2, 4, 1, 4, 2, 4, 0, 2, 0, 2, 2};
+
 WeatherData::WeatherData() : _mTemperature(0.0),
                              _mPressure(0.0),
                              _mHumidity(0.0),
@@ -39,6 +68,283 @@ WeatherData::WeatherData(double Temperature,
 {
 }
 
+bool WeatherData::readJSON(const QByteArray& Message)
+{
+    QJsonParseError Error;
+    QJsonDocument Document = QJsonDocument::fromJson(Message, &Error);
+
+    if((Error.error != QJsonParseError::NoError) || !Document.isObject())
+    {
+        return false;
+    }
+
+    // Only the transmitted values are changed, so a partial message updates the last known data
+    const QJsonObject Object = Document.object();
+    const struct
+    {
+        const char* Name;
+        double* Value;
+    } Values[] = {{"Temperature", &this->_mTemperature},
+                  {"Pressure", &this->_mPressure},
+                  {"Humidity", &this->_mHumidity},
+                  {"Ambient light", &this->_mAmbientLight},
+                  {"IAQ", &this->_mIAQ},
+                  {"Gas resistance", &this->_mGas},
+                  {"Solar", &this->_mSolar},
+                  {"Battery", &this->_mBattery}};
+
+    for(const auto& Entry : Values)
+    {
+        if(Object.contains(Entry.Name))
+        {
+            *Entry.Value = Object.value(Entry.Name).toDouble();
+        }
+    }
+
+    if(Object.contains("UV"))
+    {
+        this->_mUV = Object.value("UV").toInt();
+    }
+
+    if(Object.contains("IAQ valid"))
+    {
+        this->_mIAQValid = Object.value("IAQ valid").toBool();
+    }
+
+    if(Object.contains("Gas valid"))
+    {
+        this->_mGasValid = Object.value("Gas valid").toBool();
+    }
+
+    return true;
+}
+
+bool WeatherData::readFrame(const QByteArray& Frame)
+{
+    if((Frame.size() < (FRAME_HEADER_SIZE + FRAME_CRC_SIZE)) || (static_cast<quint8>(Frame.at(0)) != FRAME_VERSION))
+    {
+        return false;
+    }
+
+    const uchar* Data = reinterpret_cast<const uchar*>(Frame.constData());
+    int Length = Frame.size() - FRAME_CRC_SIZE;
+
+    if(WeatherData::_crc16(Frame, Length) != qFromBigEndian<quint16>(Data + Length))
+    {
+        return false;
+    }
+
+    quint8 Flags = Data[1];
+    quint16 Presence = qFromBigEndian<quint16>(Data + 2);
+
+    // Check the length before any field is copied, so a broken frame doesn´t change the data
+    int Offset = FRAME_HEADER_SIZE;
+    for(int i = 0; i < FIELD_COUNT; i++)
+    {
+        if(Presence & (1 << i))
+        {
+            Offset += FieldSize[i];
+        }
+    }
+
+    if(Offset != Length)
+    {
+        return false;
+    }
+
+    Offset = FRAME_HEADER_SIZE;
+    for(int i = 0; i < FIELD_COUNT; i++)
+    {
+        if(!(Presence & (1 << i)))
+        {
+            continue;
+        }
+
+        const uchar* Field = Data + Offset;
+        Offset += FieldSize[i];
+
+        switch(i)
+        {
+            case FIELD_TEMPERATURE:
+            {
+                this->_mTemperature = qFromBigEndian<qint16>(Field) / 100.0;
+                break;
+            }
+            case FIELD_AMBIENT_LIGHT:
+            {
+                this->_mAmbientLight = qFromBigEndian<quint32>(Field) / 100.0;
+                break;
+            }
+            case FIELD_UV:
+            {
+                this->_mUV = Field[0];
+                break;
+            }
+            case FIELD_PRESSURE:
+            {
+                this->_mPressure = qFromBigEndian<quint32>(Field) / 100.0;
+                break;
+            }
+            case FIELD_HUMIDITY:
+            {
+                this->_mHumidity = qFromBigEndian<quint16>(Field) / 100.0;
+                break;
+            }
+            case FIELD_GAS_RESISTANCE:
+            {
+                this->_mGas = qFromBigEndian<quint32>(Field);
+                break;
+            }
+            case FIELD_GAS_VALID:
+            {
+                this->_mGasValid = Flags & 0x01;
+                break;
+            }
+            case FIELD_IAQ:
+            {
+                this->_mIAQ = qFromBigEndian<quint16>(Field) / 100.0;
+                break;
+            }
+            case FIELD_IAQ_VALID:
+            {
+                this->_mIAQValid = Flags & 0x02;
+                break;
+            }
+            case FIELD_SOLAR:
+            {
+                this->_mSolar = qFromBigEndian<quint16>(Field) / 1000.0;
+                break;
+            }
+            case FIELD_BATTERY:
+            {
+                this->_mBattery = qFromBigEndian<quint16>(Field) / 1000.0;
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool WeatherData::readCBOR(const QByteArray& Message)
+{
+    QCborStreamReader Reader(Message);
+    WeatherData Data(*this);
+
+    if(!Reader.isMap() || !Reader.enterContainer())
+    {
+        return false;
+    }
+
+    while(Reader.hasNext())
+    {
+        if(!Reader.isUnsignedInteger())
+        {
+            return false;
+        }
+
+        quint64 Key = Reader.toUnsignedInteger();
+        double Value = 0.0;
+
+        Reader.next();
+
+        if(Reader.isFloat())
+        {
+            Value = Reader.toFloat();
+        }
+        else if(Reader.isDouble())
+        {
+            Value = Reader.toDouble();
+        }
+        else if(Reader.isFloat16())
+        {
+            Value = static_cast<double>(Reader.toFloat16());
+        }
+        else if(Reader.isUnsignedInteger())
+        {
+            Value = static_cast<double>(Reader.toUnsignedInteger());
+        }
+        else if(Reader.isBool())
+        {
+            Value = Reader.toBool() ? 1.0 : 0.0;
+        }
+
+        // Unknown types are skipped together with their key
+        if(!Reader.next())
+        {
+            return false;
+        }
+
+        switch(Key)
+        {
+            case FIELD_TEMPERATURE:
+            {
+                Data._mTemperature = Value;
+                break;
+            }
+            case FIELD_AMBIENT_LIGHT:
+            {
+                Data._mAmbientLight = Value;
+                break;
+            }
+            case FIELD_UV:
+            {
+                Data._mUV = static_cast<int>(Value);
+                break;
+            }
+            case FIELD_PRESSURE:
+            {
+                Data._mPressure = Value;
+                break;
+            }
+            case FIELD_HUMIDITY:
+            {
+                Data._mHumidity = Value;
+                break;
+            }
+            case FIELD_GAS_RESISTANCE:
+            {
+                Data._mGas = Value;
+                break;
+            }
+            case FIELD_GAS_VALID:
+            {
+                Data._mGasValid = (Value != 0.0);
+                break;
+            }
+            case FIELD_IAQ:
+            {
+                Data._mIAQ = Value;
+                break;
+            }
+            case FIELD_IAQ_VALID:
+            {
+                Data._mIAQValid = (Value != 0.0);
+                break;
+            }
+            case FIELD_SOLAR:
+            {
+                Data._mSolar = Value;
+                break;
+            }
+            case FIELD_BATTERY:
+            {
+                Data._mBattery = Value;
+                break;
+            }
+        }
+    }
+
+    if(!Reader.leaveContainer() || (Reader.lastError() != QCborError::NoError))
+    {
+        return false;
+    }
+
+    *this = Data;
+
+    return true;
+}
+
 QString WeatherData::toCSV(void) const
 {
     return QString("%1;%2;%3;%4;%5;%6;%7;%8;%9;%10;%11").arg(this->_mTemperature) \
@@ -108,3 +414,20 @@ bool WeatherData::iaqValid(void) const
 {
     return this->_mIAQValid;
 }
+
+quint16 WeatherData::_crc16(const QByteArray& Data, int Length)
+{
+    // CRC-16/CCITT-FALSE
+    quint16 CRC = 0xFFFF;
+
+    for(int i = 0; i < Length; i++)
+    {
+        CRC ^= static_cast<quint16>(static_cast<quint8>(Data.at(i)) << 8);
+        for(int Bit = 0; Bit < 8; Bit++)
+        {
+            CRC = (CRC & 0x8000) ? static_cast<quint16>((CRC << 1) ^ 0x1021) : static_cast<quint16>(CRC << 1);
+        }
+    }
+
+    return CRC;
+}
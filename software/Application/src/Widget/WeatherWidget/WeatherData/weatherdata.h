@@ -2,6 +2,7 @@
 #define WEATHERDATA_H
 
 #include <QString>
+#include <QByteArray>
 
 class WeatherData
 {
@@ -9,6 +10,9 @@ class WeatherData
         WeatherData();
         WeatherData(double Temperature, double Pressure, double Humidity, double AmbientLight, int UV, double IAQ, bool IAQValid, double Gas, bool GasValid, double Solar, double Battery);
 
+        bool readJSON(const QByteArray& Message);
+        bool readFrame(const QByteArray& Frame);
+        bool readCBOR(const QByteArray& Message);
         QString toCSV(void) const;
         double temperature(void) const;
         double pressure(void) const;
@@ -34,6 +38,8 @@ class WeatherData
         int _mUV;
         bool _mIAQValid;
         bool _mGasValid;
+
+        static quint16 _crc16(const QByteArray& Data, int Length);
 };
 
 #endif // WEATHERDATA_H
@@ -58,59 +58,63 @@ void MainWindow::Settings_finished(int result)
 
 void MainWindow::MQTT_Connected(void)
 {
-    if(!this->_mClient->subscribe(QString("sensorhub/weather")))
+    const QStringList Topics = {"sensorhub/weather", "sensorhub/weather/frame", "sensorhub/weather/cbor", "sensorhub/weather/batch"};
+
+    for(const QString& Topic : Topics)
     {
-        this->_mUi->statusBar->showMessage(tr("Could not subscribe to topic sensorhub/weather"));
+        if(!this->_mClient->subscribe(Topic))
+        {
+            this->_mUi->statusBar->showMessage(tr("Could not subscribe to topic %1").arg(Topic));
 
-        return;
+            return;
+        }
     }
 
-    this->_mUi->statusBar->showMessage(tr("Subscribe to topic sensorhub/weather"));
+    this->_mUi->statusBar->showMessage(tr("Subscribe to topics %1").arg(Topics.join(", ")));
 }
 
-void MainWindow::MQTT_Received(const QByteArray& message, const QMqttTopicName&)
+void MainWindow::MQTT_Received(const QByteArray& message, const QMqttTopicName& topic)
 {
-    // Convert the message into a QString to remove all additional bytes that the microcontroller sends.
-    // Unfortunately the JSON library from Particle will transmit the complete buffer and not only the JSON
-    // string. This will cause some issues to the Qt JSON parser.
-    QJsonDocument doc = QJsonDocument::fromJson(QString(message).toUtf8());
+    // The SensorHub reports only the changed measurements, so each message is merged into the last known data
+    WeatherData Data(this->_mData);
+    bool Valid;
 
     #ifdef QT_DEBUG
-        qDebug() << doc;
+        qDebug() << topic.name() << message;
     #endif
 
-    WeatherData Data(doc.object().value("Temperature").toDouble(),
-                     doc.object().value("Pressure").toDouble(),
-                     doc.object().value("Humidity").toDouble(),
-                     doc.object().value("Ambient light").toDouble(),
-                     doc.object().value("UV").toInt(),
-                     doc.object().value("IAQ").toDouble(),
-                     doc.object().value("IAQ valid").toBool(),
-                     doc.object().value("Gas").toDouble(),
-                     doc.object().value("Gas valid").toBool(),
-                     doc.object().value("Solar").toDouble(),
-                     doc.object().value("Battery").toDouble()
-                     );
-
-    if(this->_mLoggingActive)
+    if(topic.name() == "sensorhub/weather/batch")
     {
-        QString Message = QString("%1;" + Data.toCSV()).arg(QDateTime::currentDateTime().toSecsSinceEpoch());
+        if(!this->_readBatch(message))
+        {
+            this->_mUi->statusBar->showMessage(tr("Invalid message received on %1").arg(topic.name()));
+        }
 
-        #ifdef QT_DEBUG
-            qDebug() << "Logging: " << Message;
-        #endif
+        return;
+    }
 
-        this->_appendLog(Message);
+    if(topic.name() == "sensorhub/weather/frame")
+    {
+        Valid = Data.readFrame(message);
+    }
+    else if(topic.name() == "sensorhub/weather/cbor")
+    {
+        Valid = Data.readCBOR(message);
+    }
+    else
+    {
+        Valid = Data.readJSON(message);
     }
 
-    this->_mTemperatureWidget->AddDataPoint(Data.temperature());
-    this->_mHumidityWidget->AddDataPoint(Data.humidity());
-    this->_mPressureWidget->AddDataPoint(Data.pressure());
-    this->_mAmbientLightWidget->AddDataPoint(Data.ambientLight());
-    this->_mIAQWidget->AddDataPoint(Data.iaq());
-    this->_mWeatherWidget->update(Data);
+    if(!Valid)
+    {
+        this->_mUi->statusBar->showMessage(tr("Invalid message received on %1").arg(topic.name()));
+
+        return;
+    }
 
-    this->_mUi->statusBar->showMessage(tr("Update: ") + QDateTime::currentDateTime().toString("hh:mm:ss"));
+    this->_mData = Data;
+    this->_updateData(Data, QDateTime::currentDateTime());
 }
 
 void MainWindow::on_action_Connect_triggered()
@@ -276,6 +280,82 @@ void MainWindow::_switchLanguage(QString Language)
     }
 }
 
+bool MainWindow::_readBatch(const QByteArray& Message)
+{
+    // Batch format of the SensorHub firmware (see Telemetry.h)
+    const int HeaderSize = 6;
+    const int RecordHeaderSize = 5;
+
+    if((Message.size() < HeaderSize) || (static_cast<quint8>(Message.at(0)) != 0x01))
+    {
+        return false;
+    }
+
+    const uchar* Data = reinterpret_cast<const uchar*>(Message.constData());
+    quint32 Transmitted = qFromBigEndian<quint32>(Data + 1);
+    int Count = Data[5];
+    int Offset = HeaderSize;
+    QList<QPair<QDateTime, WeatherData>> Records;
+    WeatherData Record(this->_mData);
+
+    // Decode the complete batch first, so a broken batch doesn´t change the charts.
+    // The sample times are calculated from the age of each record, because the clock of the SensorHub may not be synchronized
+    QDateTime Now = QDateTime::currentDateTime();
+    for(int i = 0; i < Count; i++)
+    {
+        if((Offset + RecordHeaderSize) > Message.size())
+        {
+            return false;
+        }
+
+        quint32 Timestamp = qFromBigEndian<quint32>(Data + Offset);
+        int Length = Data[Offset + 4];
+        Offset += RecordHeaderSize;
+
+        if(((Offset + Length) > Message.size()) || !Record.readFrame(Message.mid(Offset, Length)))
+        {
+            return false;
+        }
+
+        Offset += Length;
+
+        qint64 Age = (Transmitted >= Timestamp) ? static_cast<qint64>(Transmitted - Timestamp) : 0;
+        Records.append(qMakePair(Now.addSecs(-Age), Record));
+    }
+
+    for(const auto& Entry : Records)
+    {
+        this->_updateData(Entry.second, Entry.first);
+    }
+
+    this->_mData = Record;
+
+    return true;
+}
+
+void MainWindow::_updateData(const WeatherData& Data, const QDateTime& Time)
+{
+    if(this->_mLoggingActive)
+    {
+        QString Message = QString("%1;" + Data.toCSV()).arg(Time.toSecsSinceEpoch());
+
+        #ifdef QT_DEBUG
+            qDebug() << "Logging: " << Message;
+        #endif
+
+        this->_appendLog(Message);
+    }
+
+    this->_mTemperatureWidget->AddDataPoint(Data.temperature(), Time);
+    this->_mHumidityWidget->AddDataPoint(Data.humidity(), Time);
+    this->_mPressureWidget->AddDataPoint(Data.pressure(), Time);
+    this->_mAmbientLightWidget->AddDataPoint(Data.ambientLight(), Time);
+    this->_mIAQWidget->AddDataPoint(Data.iaq(), Time);
+    this->_mWeatherWidget->update(Data);
+
+    this->_mUi->statusBar->showMessage(tr("Update: ") + Time.toString("hh:mm:ss"));
+}
+
 void MainWindow::_update(void)
 {
     QString FileName;
@@ -3,6 +3,7 @@
 
 #include <QTimer>
 #include <QString>
+#include <QtEndian>
 #include <QtCharts>
 #include <QMainWindow>
 #include <QMessageBox>
@@ -63,6 +64,8 @@ class MainWindow : public QMainWindow
         ChartWidget* _mAmbientLightWidget;
         ChartWidget* _mIAQWidget;
 
+        WeatherData _mData;
+
         QTranslator _mTranslator;
         QString _mIp;
         QString _mLog;
@@ -78,6 +81,8 @@ class MainWindow : public QMainWindow
         void _setLanguageMenu(void);
         void _switchLanguage(QString Language);
         void _update(void);
+        void _updateData(const WeatherData& Data, const QDateTime& Time);
+        bool _readBatch(const QByteArray& Message);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,302 @@
+/*
+ * CodecBenchmark.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Host benchmark for the MQTT codec.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file Benchmark/CodecBenchmark.cpp
+ *  @brief Measures the packets per second and the bytes copied per packet for each encoder and decoder
+ *         of #MQTTCodec. The copied bytes are the bytes the codec writes into the packet buffer. The payload
+ *         isn´t part of it, because the client passes the payload segments directly to the transport.
+ *         The decoders only return offsets into the receive buffer and don´t copy anything.
+ *
+ *         Usage: CodecBenchmark [Iterations]
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "MQTTCodec.h"
+
+/** @brief Size of the receive ring buffer of the firmware.
+ */
+#define BENCHMARK_RX_SIZE                       256
+
+/** @brief Payload length of the PUBLISH packets.
+ */
+#define BENCHMARK_PAYLOAD_LENGTH                200
+
+/** @brief Default number of iterations for each benchmark case.
+ */
+#define BENCHMARK_ITERATIONS                    1000000UL
+
+/** @brief Benchmark case. The function processes one packet.
+ *  @param Copied   Pointer to number of bytes copied into the packet buffer
+ *  @return         #true when the codec reports an error
+ */
+typedef bool (*Benchmark_Function)(uint32_t* Copied);
+
+typedef struct
+{
+    const char* Name;							        /**< Name of the benchmark case. */
+    Benchmark_Function Function;						/**< Function for a single packet. */
+} Benchmark;
+
+static uint8_t _Buffer[128];
+static uint8_t _Ring[BENCHMARK_RX_SIZE];
+static uint16_t _ID;
+
+static MQTTCodec::Reader _Publish;
+static MQTTCodec::Reader _Connack;
+static MQTTCodec::Reader _Ack;
+
+/** @brief          Copy a packet into the receive ring buffer, so that the packet wraps around the end of the buffer.
+ *  @param Packet   Packet
+ *  @param Length   Packet length
+ *  @param Start    Offset of the first byte in the ring buffer
+ *  @return         Reader for the packet
+ */
+static MQTTCodec::Reader _toRing(const uint8_t* Packet, uint16_t Length, uint16_t Start)
+{
+    MQTTCodec::Reader Reader = {_Ring, Start, BENCHMARK_RX_SIZE - 1, Length};
+
+    for(uint16_t i = 0x00; i < Length; i++)
+    {
+        _Ring[(Start + i) & (BENCHMARK_RX_SIZE - 1)] = Packet[i];
+    }
+
+    return Reader;
+}
+
+static bool _encodeConnect(uint32_t* Copied)
+{
+    uint16_t Start;
+    uint16_t Length;
+    MQTTCodec::ConnectOptions Options = {"SensorHub", true, 10, NULL, NULL, 0x00, false, NULL, NULL, 0x00, 0x00};
+
+    if(MQTTCodec::EncodeConnect(_Buffer, sizeof(_Buffer), MQTT_VERSION_3_1_1, Options, &Start, &Length))
+    {
+        return true;
+    }
+
+    *Copied = Length;
+
+    return false;
+}
+
+static bool _encodePublish(uint32_t* Copied)
+{
+    uint16_t Start;
+    uint16_t Length;
+    MQTTCodec::PublishOptions Options = {"sensorhub/weather", 0x00, 0x00, false, false, 0x00};
+
+    if(MQTTCodec::EncodePublish(_Buffer, sizeof(_Buffer), MQTT_VERSION_3_1_1, Options, BENCHMARK_PAYLOAD_LENGTH, &Start, &Length))
+    {
+        return true;
+    }
+
+    *Copied = Length;
+
+    return false;
+}
+
+static bool _encodePublishAlias(uint32_t* Copied)
+{
+    uint16_t Start;
+    uint16_t Length;
+    MQTTCodec::PublishOptions Options = {"", ++_ID, 0x01, false, false, 0x01};
+
+    if(MQTTCodec::EncodePublish(_Buffer, sizeof(_Buffer), MQTT_VERSION_5, Options, BENCHMARK_PAYLOAD_LENGTH, &Start, &Length))
+    {
+        return true;
+    }
+
+    *Copied = Length;
+
+    return false;
+}
+
+static bool _encodeSubscribe(uint32_t* Copied)
+{
+    uint16_t Start;
+    uint16_t Length;
+    MQTTCodec::TopicFilter Filters[] = {{"sensorhub/config/#", 0x01}, {"sensorhub/command", 0x00}};
+
+    if(MQTTCodec::EncodeSubscribe(_Buffer, sizeof(_Buffer), MQTT_VERSION_3_1_1, ++_ID, Filters, 0x02, &Start, &Length))
+    {
+        return true;
+    }
+
+    *Copied = Length;
+
+    return false;
+}
+
+static bool _encodeAck(uint32_t* Copied)
+{
+    *Copied = MQTTCodec::EncodeAck(_Buffer, MQTTCodec::PUBACK, ++_ID);
+
+    return false;
+}
+
+static bool _encodeLength(uint32_t* Copied)
+{
+    *Copied = MQTTCodec::EncodeLength(_Buffer, 268435455UL - _ID++);
+
+    return false;
+}
+
+static bool _decodePublish(uint32_t* Copied)
+{
+    MQTTCodec::FixedHeader Header;
+    MQTTCodec::PublishInfo Info;
+
+    if(MQTTCodec::DecodeFixedHeader(_Publish, &Header) || MQTTCodec::DecodePublish(_Publish, MQTT_VERSION_3_1_1, Header.Size, &Info))
+    {
+        return true;
+    }
+
+    *Copied = 0x00;
+
+    return false;
+}
+
+static bool _decodeConnack(uint32_t* Copied)
+{
+    MQTTCodec::FixedHeader Header;
+    MQTTCodec::Connack Connack;
+
+    if(MQTTCodec::DecodeFixedHeader(_Connack, &Header) || MQTTCodec::DecodeConnack(_Connack, MQTT_VERSION_5, Header.Size, &Connack))
+    {
+        return true;
+    }
+
+    *Copied = 0x00;
+
+    return false;
+}
+
+static bool _decodeAck(uint32_t* Copied)
+{
+    MQTTCodec::FixedHeader Header;
+    MQTTCodec::Ack Ack;
+
+    if(MQTTCodec::DecodeFixedHeader(_Ack, &Header) || MQTTCodec::DecodeAck(_Ack, MQTT_VERSION_3_1_1, Header.Size, &Ack))
+    {
+        return true;
+    }
+
+    *Copied = 0x00;
+
+    return false;
+}
+
+/** @brief  Prepare the received packets for the decoder cases.
+ *  @return #true when a packet can´t be encoded
+ */
+static bool _prepare(void)
+{
+    uint8_t Packet[BENCHMARK_RX_SIZE];
+    uint16_t Start;
+    uint16_t Length;
+    MQTTCodec::PublishOptions Options = {"sensorhub/config/interval", 0x01, 0x01, false, false, 0x00};
+
+    // PUBLISH with QoS 1 at the end of the ring buffer
+    if(MQTTCodec::EncodePublish(_Buffer, sizeof(_Buffer), MQTT_VERSION_3_1_1, Options, 0x10, &Start, &Length))
+    {
+        return true;
+    }
+
+    memcpy(Packet, _Buffer + Start, Length);
+    memset(Packet + Length, 0x55, 0x10);
+    _Publish = _toRing(Packet, Length + 0x10, BENCHMARK_RX_SIZE - 0x10);
+
+    // MQTT 5 CONNACK with receive maximum, topic alias maximum and maximum packet size
+    const uint8_t Connack[] = {0x20, 0x0E, 0x00, 0x00, 0x0B, MQTTCodec::PROPERTY_RECEIVE_MAXIMUM, 0x00, 0x0A,
+                               MQTTCodec::PROPERTY_TOPIC_ALIAS_MAXIMUM, 0x00, 0x05,
+                               MQTTCodec::PROPERTY_MAXIMUM_PACKET_SIZE, 0x00, 0x00, 0x04, 0x00};
+    _Connack = _toRing(Connack, sizeof(Connack), 0x00);
+
+    const uint8_t Ack[] = {0x40, 0x02, 0x12, 0x34};
+    _Ack = _toRing(Ack, sizeof(Ack), 0x40);
+
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    bool Failed = false;
+    uint32_t Iterations = BENCHMARK_ITERATIONS;
+    const Benchmark Cases[] = {
+        {"EncodeConnect", _encodeConnect},
+        {"EncodePublish (QoS 0)", _encodePublish},
+        {"EncodePublish (MQTT 5 alias)", _encodePublishAlias},
+        {"EncodeSubscribe", _encodeSubscribe},
+        {"EncodeAck", _encodeAck},
+        {"EncodeLength", _encodeLength},
+        {"DecodePublish (ring)", _decodePublish},
+        {"DecodeConnack (MQTT 5)", _decodeConnack},
+        {"DecodeAck", _decodeAck},
+    };
+
+    if(argc > 1)
+    {
+        Iterations = strtoul(argv[1], NULL, 10);
+    }
+
+    if((Iterations == 0x00) || _prepare())
+    {
+        return EXIT_FAILURE;
+    }
+
+    printf("%-30s %15s %15s\n", "Case", "Packets/s", "Bytes/packet");
+
+    for(const Benchmark& Case : Cases)
+    {
+        uint64_t Copied = 0x00;
+        bool Error = false;
+
+        std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+        for(uint32_t i = 0x00; i < Iterations; i++)
+        {
+            uint32_t Bytes = 0x00;
+
+            Error |= Case.Function(&Bytes);
+            Copied += Bytes;
+        }
+        std::chrono::duration<double> Time = std::chrono::steady_clock::now() - Start;
+
+        if(Error)
+        {
+            printf("%-30s %15s\n", Case.Name, "ERROR");
+            Failed = true;
+
+            continue;
+        }
+
+        printf("%-30s %15.0f %15.1f\n", Case.Name, Iterations / Time.count(), (double)Copied / Iterations);
+    }
+
+    return Failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
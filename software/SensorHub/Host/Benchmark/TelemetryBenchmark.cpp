@@ -0,0 +1,126 @@
+/*
+ * TelemetryBenchmark.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Host benchmark for the telemetry encoders.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file Benchmark/TelemetryBenchmark.cpp
+ *  @brief Compares the CBOR encoder of #Telemetry with the JSON encoder. The binary frame is measured as reference.
+ *         Each format is measured with all fields and with a partial report, like it is transmitted when only
+ *         some measurements have left their deadband. The benchmark prints the messages per second and the
+ *         message length.
+ *
+ *         Usage: TelemetryBenchmark [Iterations]
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Telemetry/Telemetry.h"
+
+/** @brief Default number of iterations for each benchmark case.
+ */
+#define BENCHMARK_ITERATIONS                    1000000UL
+
+/** @brief Fields of a partial report.
+ */
+#define BENCHMARK_PARTIAL_FIELDS                ((0x01 << Telemetry::FIELD_TEMPERATURE) | (0x01 << Telemetry::FIELD_HUMIDITY) | (0x01 << Telemetry::FIELD_BATTERY))
+
+typedef struct
+{
+    const char* Name;							        /**< Name of the benchmark case. */
+    Telemetry::Format Format;							/**< Message format. */
+    uint16_t Fields;							        /**< Fields of the message. */
+} Benchmark;
+
+int main(int argc, char** argv)
+{
+    bool Failed = false;
+    char Buffer[TELEMETRY_JSON_SIZE];
+    uint32_t Iterations = BENCHMARK_ITERATIONS;
+    Sensors::SensorData Data;
+    const Benchmark Cases[] = {
+        {"JSON (all fields)", Telemetry::FORMAT_JSON, TELEMETRY_ALL_FIELDS},
+        {"CBOR (all fields)", Telemetry::FORMAT_CBOR, TELEMETRY_ALL_FIELDS},
+        {"Frame (all fields)", Telemetry::FORMAT_FRAME, TELEMETRY_ALL_FIELDS},
+        {"JSON (3 fields)", Telemetry::FORMAT_JSON, BENCHMARK_PARTIAL_FIELDS},
+        {"CBOR (3 fields)", Telemetry::FORMAT_CBOR, BENCHMARK_PARTIAL_FIELDS},
+        {"Frame (3 fields)", Telemetry::FORMAT_FRAME, BENCHMARK_PARTIAL_FIELDS},
+    };
+
+    if(argc > 1)
+    {
+        Iterations = strtoul(argv[1], NULL, 10);
+    }
+
+    if(Iterations == 0x00)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Typical measurement of the SensorHub
+    Data.Temperature = 21.37;
+    Data.Environment.Temperature = 21.9;
+    Data.Environment.Pressure = 1013.25;
+    Data.Environment.Humidity = 45.6;
+    Data.Environment.GasResistance = 125000.0;
+    Data.Environment.GasValid = true;
+    Data.AmbientLight = 1234.5;
+    Data.IAQ.Value = 57.3;
+    Data.IAQ.Valid = true;
+    Data.UV = 3;
+    Data.SolarVoltage = 5.12;
+    Data.BatteryVoltage = 3.97;
+
+    printf("%-30s %15s %15s\n", "Case", "Messages/s", "Bytes/message");
+
+    for(const Benchmark& Case : Cases)
+    {
+        uint16_t Length = 0x00;
+        uint64_t Bytes = 0x00;
+
+        std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+        for(uint32_t i = 0x00; i < Iterations; i++)
+        {
+            // Change the measurement with each message, so the encoder can´t be optimized away
+            Data.Temperature = 21.37 + (i & 0x0F);
+
+            Length = Telemetry::Write(Case.Format, &Data, Case.Fields, Buffer, sizeof(Buffer));
+            Bytes += Length;
+        }
+        std::chrono::duration<double> Time = std::chrono::steady_clock::now() - Start;
+
+        if(Length == 0x00)
+        {
+            printf("%-30s %15s\n", Case.Name, "ERROR");
+            Failed = true;
+
+            continue;
+        }
+
+        printf("%-30s %15.0f %15.1f\n", Case.Name, Iterations / Time.count(), (double)Bytes / Iterations);
+    }
+
+    return Failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
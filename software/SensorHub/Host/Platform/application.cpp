@@ -0,0 +1,40 @@
+/*
+ * application.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Minimal Device OS interface for the host build.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file Platform/application.cpp
+ *  @brief Minimal Device OS interface for the host build.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <time.h>
+
+#include "application.h"
+
+TimeClass Time;
+
+uint32_t TimeClass::now(void)
+{
+    return time(NULL);
+}
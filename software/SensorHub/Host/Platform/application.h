@@ -0,0 +1,68 @@
+/*
+ * application.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Minimal Device OS interface for the host build.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+#pragma once
+
+/** @file Platform/application.h
+ *  @brief Replaces the Device OS header for the host build. Only the parts which are used by the
+ *         Device OS independent modules (i. e. #Telemetry or #MQTTDispatcher) are provided.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/** @brief The host has no retained memory. The variables are placed in the normal RAM.
+ */
+#define retained
+
+/** @brief Access to the RTC of the device.
+ */
+class TimeClass
+{
+    public:
+        /** @brief  Get the current time.
+         *  @return Seconds since 1.1.1970
+         */
+        uint32_t now(void);
+};
+
+extern TimeClass Time;
+
+/** @brief Placeholders for the network types of the Device OS. They are only needed to compile the header
+ *         of the MQTT client, because the host build doesn´t use the client itself.
+ */
+class IPAddress
+{
+};
+
+class TCPClient
+{
+};
+
+class String;
+class Timer;
@@ -0,0 +1,281 @@
+/*
+ * MQTTDispatcherTest.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Host test for the topic filter dispatcher.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file Test/MQTTDispatcherTest.cpp
+ *  @brief Matches topics against a set of topic filters with #MQTTDispatcher. Each topic is copied into a ring
+ *         buffer at every possible wrap point, like the MQTT client passes it from its receive buffer, and the
+ *         called handlers are compared with the expected ones. The test also covers the '$' topic rule,
+ *         invalid filters and a full node table.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "MQTTDispatcher.h"
+
+/** @brief Size of the ring buffer for the topic views. Must be a power of two.
+ */
+#define TEST_RING_SIZE                          64
+
+/** @brief Test case.
+ */
+typedef struct
+{
+    const char* Topic;							        /**< Received topic. */
+    uint16_t Expected;							        /**< Bit mask with the handlers which must be called. */
+} Case;
+
+// Bit mask of the called handlers
+static uint16_t _Called;
+
+/** @brief Handler for the topic filter with the index Bit.
+ */
+template<uint8_t Bit> static void _handler(const MQTT::View* Topic, const MQTT::View* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP)
+{
+    _Called |= (0x01 << Bit);
+}
+
+static const char* _Filters[] = {"sensorhub/weather", "sensorhub/+", "sensorhub/#", "+/config/interval", "#", "$SYS/#", "sensorhub/config/+", "+/+", "+/leading"};
+static const MQTT::Publish_Callback _Handlers[] = {_handler<0>, _handler<1>, _handler<2>, _handler<3>, _handler<4>, _handler<5>, _handler<6>, _handler<7>, _handler<8>};
+
+/** @brief              Dispatch a topic for each possible wrap point of the view.
+ *  @param Dispatcher   Dispatcher
+ *  @param Test         Test case
+ *  @return             #true when the test has failed
+ */
+static bool _run(MQTTDispatcher& Dispatcher, const Case& Test)
+{
+    char Ring[TEST_RING_SIZE];
+    uint16_t Length = strlen(Test.Topic);
+    uint8_t Expected = 0x00;
+
+    for(uint16_t Bits = Test.Expected; Bits; Bits >>= 0x01)
+    {
+        Expected += Bits & 0x01;
+    }
+
+    // The first part of the view ends at the end of the ring buffer. The remaining characters start at the beginning
+    for(uint16_t Split = 0x00; Split <= Length; Split++)
+    {
+        uint16_t Start = TEST_RING_SIZE - Split;
+        MQTT::View Topic = {Ring + Start, Split, (Split < Length) ? Ring : NULL, (uint16_t)(Length - Split)};
+        MQTT::View Payload = {NULL, 0x00, NULL, 0x00};
+
+        // Fill the unused part of the ring buffer, so a read outside of the view doesn´t find a topic separator
+        memset(Ring, 'x', sizeof(Ring));
+        for(uint16_t i = 0x00; i < Length; i++)
+        {
+            Ring[(Start + i) & (TEST_RING_SIZE - 1)] = Test.Topic[i];
+        }
+
+        _Called = 0x00;
+        uint8_t Count = Dispatcher.Dispatch(&Topic, &Payload, 0x00, MQTT::QOS_0, false);
+        if((_Called != Test.Expected) || (Count != Expected))
+        {
+            printf("%s (wrap after %u characters): handlers 0x%03X, expected 0x%03X\n", Test.Topic, Split, _Called, Test.Expected);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/** @brief  Register filters until the node table is full.
+ *  @return #true when the test has failed
+ */
+static bool _runNodeTable(void)
+{
+    MQTTDispatcher Dispatcher;
+    static char Filters[MQTT_DISPATCHER_MAX_NODES][8];
+    uint8_t Registered = 0x00;
+
+    // The root node and the node for "t" are used by all filters. Each filter adds one node
+    for(uint8_t i = 0x00; i < MQTT_DISPATCHER_MAX_NODES; i++)
+    {
+        snprintf(Filters[i], sizeof(Filters[i]), "t/%u", i);
+
+        MQTTDispatcher::Error Error = Dispatcher.Register(Filters[i], _handler<0>);
+        if(Error == MQTTDispatcher::NO_MEMORY)
+        {
+            break;
+        }
+        else if(Error != MQTTDispatcher::NO_ERROR)
+        {
+            printf("Node table: %s returned %u\n", Filters[i], Error);
+
+            return true;
+        }
+
+        Registered++;
+    }
+
+    if(Registered != (MQTT_DISPATCHER_MAX_NODES - 0x02))
+    {
+        printf("Node table: %u filters registered, expected %u\n", Registered, MQTT_DISPATCHER_MAX_NODES - 0x02);
+
+        return true;
+    }
+
+    // Known filters don´t need new nodes
+    if(Dispatcher.Register(Filters[0], _handler<1>) || (Dispatcher.Register("t/#", _handler<2>) != MQTTDispatcher::NO_MEMORY))
+    {
+        printf("Node table: a full table must only accept known filters\n");
+
+        return true;
+    }
+
+    // The last filter is still matched and the replaced handler is used for the first filter
+    const Case Tests[] = {
+        {Filters[Registered - 0x01], 0x01 << 0x00},
+        {Filters[0], 0x01 << 0x01},
+        {"t/unknown", 0x00},
+    };
+
+    for(const Case& Test : Tests)
+    {
+        if(_run(Dispatcher, Test))
+        {
+            return true;
+        }
+    }
+
+    if(Dispatcher.Unregister(Filters[0]) || (Dispatcher.Unregister(Filters[0]) != MQTTDispatcher::NOT_FOUND) ||
+       (Dispatcher.Unregister("t/unknown") != MQTTDispatcher::NOT_FOUND))
+    {
+        printf("Node table: unregister failed\n");
+
+        return true;
+    }
+
+    return false;
+}
+
+/** @brief  Register invalid topic filters.
+ *  @return #true when the test has failed
+ */
+static bool _runInvalid(void)
+{
+    MQTTDispatcher Dispatcher;
+    const char* Filters[] = {"", "sensorhub/#/weather", "sensorhub/weather+", "sensor#", "+hub/weather"};
+
+    for(const char* Filter : Filters)
+    {
+        if(Dispatcher.Register(Filter, _handler<0>) != MQTTDispatcher::INVALID_FILTER)
+        {
+            printf("Invalid filter \"%s\" was accepted\n", Filter);
+
+            return true;
+        }
+    }
+
+    if(Dispatcher.Register(NULL, _handler<0>) != MQTTDispatcher::INVALID_FILTER)
+    {
+        printf("Invalid filter NULL was accepted\n");
+
+        return true;
+    }
+
+    if(Dispatcher.Register("sensorhub/weather", NULL) != MQTTDispatcher::INVALID_FILTER)
+    {
+        printf("Missing handler was accepted\n");
+
+        return true;
+    }
+
+    return false;
+}
+
+int main(void)
+{
+    int Failed = 0x00;
+    uint16_t Total = 0x00;
+    MQTTDispatcher Dispatcher;
+
+    // Bit n of the expected value marks the handler of the filter _Filters[n]
+    const Case Tests[] = {
+        {"sensorhub/weather", (0x01 << 0x00) | (0x01 << 0x01) | (0x01 << 0x02) | (0x01 << 0x04) | (0x01 << 0x07)},
+        {"sensorhub/config", (0x01 << 0x01) | (0x01 << 0x02) | (0x01 << 0x04) | (0x01 << 0x07)},
+        {"sensorhub/config/interval", (0x01 << 0x02) | (0x01 << 0x03) | (0x01 << 0x04) | (0x01 << 0x06)},
+        {"sensorhub/weather/extra", (0x01 << 0x02) | (0x01 << 0x04)},
+        // The multi level wildcard also matches the parent level
+        {"sensorhub", (0x01 << 0x02) | (0x01 << 0x04)},
+        {"other/config/interval", (0x01 << 0x03) | (0x01 << 0x04)},
+        {"other", 0x01 << 0x04},
+        // Empty topic levels are valid levels
+        {"/leading", (0x01 << 0x04) | (0x01 << 0x07) | (0x01 << 0x08)},
+        {"sensorhub/", (0x01 << 0x01) | (0x01 << 0x02) | (0x01 << 0x04) | (0x01 << 0x07)},
+        // Wildcards in the first level don´t match topics starting with '$'
+        {"$SYS/broker/uptime", 0x01 << 0x05},
+        {"$SYS", 0x01 << 0x05},
+        {"$other/config/interval", 0x00},
+        {"$other/config", 0x00},
+    };
+
+    for(uint8_t i = 0x00; i < (sizeof(_Filters) / sizeof(_Filters[0])); i++)
+    {
+        if(Dispatcher.Register(_Filters[i], _Handlers[i]))
+        {
+            printf("Filter \"%s\" was rejected\n", _Filters[i]);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    for(const Case& Test : Tests)
+    {
+        if(_run(Dispatcher, Test))
+        {
+            Failed++;
+        }
+
+        Total++;
+    }
+
+    // A removed filter isn´t matched anymore
+    const Case Removed = {"sensorhub/weather", (0x01 << 0x01) | (0x01 << 0x02) | (0x01 << 0x04) | (0x01 << 0x07)};
+    if(Dispatcher.Unregister(_Filters[0]) || _run(Dispatcher, Removed))
+    {
+        Failed++;
+    }
+    Total++;
+
+    if(_runNodeTable())
+    {
+        Failed++;
+    }
+    Total++;
+
+    if(_runInvalid())
+    {
+        Failed++;
+    }
+    Total++;
+
+    printf("%u of %u tests passed\n", (unsigned int)(Total - Failed), (unsigned int)Total);
+
+    return Failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
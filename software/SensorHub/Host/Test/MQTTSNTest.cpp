@@ -0,0 +1,231 @@
+/*
+ * MQTTSNTest.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Host test for the MQTT-SN encoder with a local gateway stand-in.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file Test/MQTTSNTest.cpp
+ *  @brief Transmits QoS -1 PUBLISH messages, encoded with #MQTTSNCodec, as UDP datagrams to a gateway stand-in
+ *         on the loopback interface. The header and the payload are passed as separate segments, like the
+ *         firmware does with the UDP client. The stand-in parses each datagram as described in the
+ *         MQTT-SN 1.2 specification and compares it with the transmitted message.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "MQTTSNCodec.h"
+
+/** @brief Test case.
+ */
+typedef struct
+{
+    const char* Name;							        /**< Name of the test case. */
+    uint8_t TopicType;							        /**< Type of the topic ID. */
+    uint16_t TopicID;							        /**< Topic ID or short topic name. */
+    bool Retain;							            /**< Retain flag. */
+    uint16_t PayloadLength;							    /**< Length of the payload. */
+    MQTTSNCodec::Error Expected;						/**< Expected result of the encoder. */
+} Case;
+
+/** @brief Message received by the gateway stand-in.
+ */
+typedef struct
+{
+    uint16_t Length;							        /**< Value of the length field. */
+    uint8_t Type;							            /**< Message type. */
+    uint8_t Flags;							            /**< Flags. */
+    uint16_t TopicID;							        /**< Topic ID. */
+    uint16_t MessageID;							        /**< Message ID. */
+    const uint8_t* Payload;							    /**< Pointer to payload. */
+    uint16_t PayloadLength;							    /**< Length of the payload. */
+} Message;
+
+/** @brief          Parse a datagram as MQTT-SN PUBLISH message.
+ *  @param Data     Datagram
+ *  @param Length   Datagram length
+ *  @param Message  Pointer to message object
+ *  @return         #true when the datagram isn´t a valid message
+ */
+static bool _parse(const uint8_t* Data, uint16_t Length, Message* Message)
+{
+    uint16_t Offset = 0x01;
+
+    if(Length < 0x02)
+    {
+        return true;
+    }
+
+    // A length field with the value 0x01 is followed by the length as 16 bit value
+    Message->Length = Data[0];
+    if(Data[0] == 0x01)
+    {
+        if(Length < 0x03)
+        {
+            return true;
+        }
+
+        Message->Length = (Data[1] << 0x08) | Data[2];
+        Offset = 0x03;
+    }
+
+    // The length field contains the length of the complete message
+    if((Message->Length != Length) || (Length < (Offset + 0x06)))
+    {
+        return true;
+    }
+
+    Message->Type = Data[Offset];
+    Message->Flags = Data[Offset + 0x01];
+    Message->TopicID = (Data[Offset + 0x02] << 0x08) | Data[Offset + 0x03];
+    Message->MessageID = (Data[Offset + 0x04] << 0x08) | Data[Offset + 0x05];
+    Message->Payload = Data + Offset + 0x06;
+    Message->PayloadLength = Length - Offset - 0x06;
+
+    return false;
+}
+
+/** @brief          Run a test case.
+ *  @param Client   Socket of the client
+ *  @param Gateway  Socket of the gateway stand-in
+ *  @param Test     Test case
+ *  @return         #true when the test has failed
+ */
+static bool _run(int Client, int Gateway, const Case& Test)
+{
+    uint8_t Header[MQTTSN_PUBLISH_HEADER_SIZE];
+    uint8_t Payload[MQTTSN_MAX_PACKET_SIZE];
+    uint8_t Datagram[MQTTSN_MAX_PACKET_SIZE + 0x10];
+    uint8_t HeaderLength;
+    Message Received;
+    MQTTSNCodec::Error Error;
+
+    for(uint16_t i = 0x00; i < sizeof(Payload); i++)
+    {
+        Payload[i] = i ^ Test.TopicID;
+    }
+
+    Error = MQTTSNCodec::EncodePublish(Header, Test.TopicType, Test.TopicID, Test.Retain, Test.PayloadLength, &HeaderLength);
+    if(Error != Test.Expected)
+    {
+        printf("%s: encoder returned %u\n", Test.Name, Error);
+
+        return true;
+    }
+
+    if(Error != MQTTSNCodec::NO_ERROR)
+    {
+        return false;
+    }
+
+    // Transmit the header and the payload as a single datagram
+    struct iovec Segments[] = {{Header, HeaderLength}, {Payload, Test.PayloadLength}};
+    struct msghdr Packet = {};
+    Packet.msg_iov = Segments;
+    Packet.msg_iovlen = 0x02;
+    if(sendmsg(Client, &Packet, 0x00) != (HeaderLength + Test.PayloadLength))
+    {
+        printf("%s: transmission failed\n", Test.Name);
+
+        return true;
+    }
+
+    ssize_t Length = recv(Gateway, Datagram, sizeof(Datagram), 0x00);
+    if((Length <= 0x00) || _parse(Datagram, Length, &Received))
+    {
+        printf("%s: gateway has received an invalid message\n", Test.Name);
+
+        return true;
+    }
+
+    // QoS -1 uses both QoS bits. The message ID is always zero
+    if((Received.Type != MQTTSNCodec::PUBLISH) || (Received.Flags != ((0x03 << 0x05) | (Test.Retain << 0x04) | Test.TopicType)) ||
+       (Received.TopicID != Test.TopicID) || (Received.MessageID != 0x00) || (Received.PayloadLength != Test.PayloadLength) ||
+       memcmp(Received.Payload, Payload, Test.PayloadLength))
+    {
+        printf("%s: gateway has received a different message\n", Test.Name);
+
+        return true;
+    }
+
+    return false;
+}
+
+int main(void)
+{
+    int Failed = 0x00;
+    struct sockaddr_in Address = {};
+    socklen_t AddressLength = sizeof(Address);
+    struct timeval Timeout = {2, 0};
+
+    const Case Tests[] = {
+        {"Predefined topic", 0x01, 0x0001, false, 40, MQTTSNCodec::NO_ERROR},
+        {"Short topic with retain", 0x02, ('w' << 0x08) | 'x', true, 12, MQTTSNCodec::NO_ERROR},
+        {"Empty payload", 0x01, 0x0002, false, 0, MQTTSNCodec::NO_ERROR},
+        {"Largest short length field", 0x01, 0x0003, false, 248, MQTTSNCodec::NO_ERROR},
+        {"Smallest long length field", 0x01, 0x0003, false, 249, MQTTSNCodec::NO_ERROR},
+        {"Largest message", 0x01, 0x0004, false, MQTTSN_MAX_PACKET_SIZE - 9, MQTTSNCodec::NO_ERROR},
+        {"Message too large", 0x01, 0x0004, false, MQTTSN_MAX_PACKET_SIZE - 8, MQTTSNCodec::BUFFER_OVERFLOW},
+    };
+
+    // The gateway stand-in listens on a free port of the loopback interface
+    int Gateway = socket(AF_INET, SOCK_DGRAM, 0x00);
+    int Client = socket(AF_INET, SOCK_DGRAM, 0x00);
+    if((Gateway < 0x00) || (Client < 0x00))
+    {
+        return EXIT_FAILURE;
+    }
+
+    Address.sin_family = AF_INET;
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    Address.sin_port = 0x00;
+    if(bind(Gateway, (struct sockaddr*)&Address, sizeof(Address)) ||
+       getsockname(Gateway, (struct sockaddr*)&Address, &AddressLength) ||
+       setsockopt(Gateway, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout)) ||
+       connect(Client, (struct sockaddr*)&Address, sizeof(Address)))
+    {
+        return EXIT_FAILURE;
+    }
+
+    for(const Case& Test : Tests)
+    {
+        if(_run(Client, Gateway, Test))
+        {
+            Failed++;
+        }
+    }
+
+    close(Client);
+    close(Gateway);
+
+    printf("%u of %u tests passed\n", (unsigned int)(sizeof(Tests) / sizeof(Tests[0]) - Failed), (unsigned int)(sizeof(Tests) / sizeof(Tests[0])));
+
+    return Failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
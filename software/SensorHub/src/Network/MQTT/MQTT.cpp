@@ -30,46 +30,102 @@
 
 #include "MQTT.h"
 
-/** @brief Constant for MQTT version 3.1.1.
- */
-#define MQTT_VERSION_3_1_1                      0x04
-
-/** @brief Constant for MQTT version 3.1.
- */
-#define MQTT_VERSION_3_1                        0x03
-
 bool MQTT::isConnected(void)
 {
     return this->_mClient.connected();
 }
 
+bool MQTT::isReconnecting(void) const
+{
+    return this->_mReconnectPending;
+}
+
+uint32_t MQTT::backoff(uint8_t Attempt)
+{
+    uint32_t Delay = MQTT_RECONNECT_MAX_DELAY;
+
+    if(Attempt < 0x10)
+    {
+        Delay = (uint32_t)MQTT_RECONNECT_MIN_DELAY << Attempt;
+        if(Delay > MQTT_RECONNECT_MAX_DELAY)
+        {
+            Delay = MQTT_RECONNECT_MAX_DELAY;
+        }
+    }
+
+    // Keep one half of the delay and randomize the other half
+    return (Delay / 0x02) + random((Delay / 0x02) + 0x01);
+}
+
 MQTT::ConnectionState MQTT::connectionState(void) const
 {
     return this->_mConnectionState;
 }
 
-MQTT::MQTT(void)
+MQTT::ReasonCode MQTT::reasonCode(void) const
 {
-    this->_init(IPAddress(0, 0, 0, 0), 0, MQTT_DEFAULT_KEEPALIVE, NULL);
+    return this->_mReasonCode;
 }
 
-MQTT::MQTT(IPAddress IP)
+void MQTT::statistics(MQTT::Statistics* Statistics) const
 {
-    this->_init(IP, MQTT_DEFAULT_PORT, MQTT_DEFAULT_KEEPALIVE, NULL);
+    if(Statistics == NULL)
+    {
+        return;
+    }
+
+    *Statistics = this->_mStatistics;
+    Statistics->QueueOverflows = this->_mQueueOverflows;
+}
+
+void MQTT::ResetStatistics(void)
+{
+    memset(&this->_mStatistics, 0x00, sizeof(MQTT::Statistics));
+    this->_mQueueOverflows = 0x00;
 }
 
-MQTT::MQTT(IPAddress IP, uint16_t Port)
+uint8_t MQTT::inflight(void) const
 {
-    this->_init(IP, Port, MQTT_DEFAULT_KEEPALIVE, NULL);
+    uint8_t Count = 0x00;
+
+    for(uint8_t i = 0x00; i < this->_mMaxInflight; i++)
+    {
+        if(this->_mInflight[i].State != INFLIGHT_FREE)
+        {
+            Count++;
+        }
+    }
+
+    return Count;
 }
 
-MQTT::MQTT(IPAddress IP, uint16_t Port, uint16_t KeepAlive)
+MQTT::Status MQTT::status(void)
 {
-    this->_init(IP, Port, KeepAlive, NULL);
+    // The connection can be closed by the broker at any time
+    if((this->_mStatus == CONNECTED) && (!this->isConnected()))
+    {
+        return DISCONNECTED;
+    }
+
+    return this->_mStatus;
 }
 
-MQTT::MQTT(IPAddress IP, uint16_t Port, uint16_t KeepAlive, Publish_Callback Callback)
+MQTT::MQTT(const MQTT::Storage& Storage, IPAddress IP, uint16_t Port, uint16_t KeepAlive, Publish_Callback Callback)
 {
+    this->_mBuffer = Storage.Buffer;
+    this->_mBufferSize = Storage.BufferSize;
+    this->_mRxBuffer = Storage.RxBuffer;
+    this->_mRxBufferSize = Storage.RxBufferSize;
+    this->_mInflight = Storage.InflightWindow;
+    this->_mMaxInflight = Storage.MaxInflight;
+    this->_mInflightSize = Storage.InflightSize;
+    this->_mQueue = Storage.Queue;
+    this->_mQueueSize = Storage.QueueSize;
+    this->_mQueueEntrySize = Storage.QueueEntrySize;
+    this->_mCorkBuffer = Storage.CorkBuffer;
+    this->_mCorkBufferSize = Storage.CorkBufferSize;
+    this->_mVersion = Storage.Version;
+
     this->_init(IP, Port, KeepAlive, Callback);
 }
 
@@ -104,151 +160,244 @@ MQTT::Error MQTT::Connect(const char* ClientID, bool CleanSession, MQTT::Will* W
 
 MQTT::Error MQTT::Connect(const char* ClientID, bool CleanSession, MQTT::Will* Will, MQTT::User* User)
 {
-    uint16_t Length = MQTT_FIXED_HEADER_SIZE;
+    MQTT::Error Error = this->BeginConnect(ClientID, CleanSession, Will, User);
+    if(Error)
+    {
+        return Error;
+    }
+
+    // Wait for the answer from the broker
+    while(this->_mStatus == CONNECTING)
+    {
+        this->Poll();
+    }
+
+    return this->_mConnectError;
+}
 
-    if(ClientID == NULL)
+MQTT::Error MQTT::BeginConnect(const char* ClientID, bool CleanSession, MQTT::Will* Will, MQTT::User* User)
+{
+    if((ClientID == NULL) || (Will && (!(Will->Message) || !(Will->Topic))) || (User && !(User->Name)))
     {
         return INVALID_PARAMETER;
     }
 
+    // Save the parameters for the reconnect
+    this->_mClientID = ClientID;
+    this->_mCleanSession = CleanSession;
+    this->_mWill = Will;
+    this->_mUser = User;
+
     if(!this->isConnected())
     {
-        if(_mClient.connect(this->_mIP, this->_mPort))
+        // A clean session discards all unacknowledged messages from the previous session
+        if(CleanSession)
         {
-            uint8_t Flags = 0x00;
-
             this->_mCurrentMessageID = 0x01;
 
-            // Set the protocol name and the protocol level
-            #if(MQTT_VERSION == MQTT_VERSION_3_1)
-                const uint8_t Header[] = {0x00, 0x06, 'M', 'Q', 'I', 's', 'd', 'p', MQTT_VERSION};
-            #elif(MQTT_VERSION == MQTT_VERSION_3_1_1)
-                const uint8_t Header[] = {0x00, 0x04, 'M', 'Q', 'T', 'T', MQTT_VERSION};
-            #endif
-
-            memcpy(this->_mBuffer + MQTT_FIXED_HEADER_SIZE, Header, sizeof(Header));
-            Length += sizeof(Header);
-
-            Flags |= CleanSession << 0x01;
-
-            if(Will)
-            {
-                if(!(Will->Message) || (!(Will->Topic)))
-                {
-                    return INVALID_PARAMETER;
-                }
-
-                Flags |= (((uint8_t)Will->Retain) << 0x05) | (((uint8_t)Will->QoS) << 0x03) | (0x01 << 0x02);
-            }
-
-            if(User)
+            for(uint8_t i = 0x00; i < this->_mMaxInflight; i++)
             {
-                if(!(User->Name))
-                {
-                    return INVALID_PARAMETER;
-                }
-
-                Flags |= (0x01 << 0x07);
-
-                if(User->Password)
-                {
-                    Flags |= (0x01 << 0x06);
-                }
+                this->_mInflight[i].State = INFLIGHT_FREE;
             }
+        }
 
-            // Set the flags
-            this->_mBuffer[Length++] = Flags;
-
-            // Set keep alive
-            this->_mBuffer[Length++] = (this->_mKeepAlive >> 0x08);
-            this->_mBuffer[Length++] = (this->_mKeepAlive & 0xFF);
-
-            // Set the client ID
-            this->_copyString(ClientID, &Length);
+        if(this->_mClient.connect(this->_mIP, this->_mPort))
+        {
+            MQTTCodec::Error Error;
+            MQTTCodec::ConnectOptions Options;
+            uint16_t Offset;
+            uint16_t Length;
+
+            this->_mStreamRemaining = 0x00;
+            this->_mStreamMessage = NULL;
+            this->_mPingQueued = false;
+            this->_mWaitForHostPing = false;
+            this->_mPingTimeout = false;
+            this->_mCorkLength = 0x00;
+            this->_mRxState = RX_FIXED_HEADER;
+            this->_mRxTail = 0x00;
+            this->_mRxCount = 0x00;
+
+            // The requests of the previous connection are never answered
+            this->_mPendingCount = 0x00;
+
+            // Use the protocol defaults until the broker reports its limits with the CONNACK
+            this->_mReasonCode = REASON_SUCCESS;
+            this->_mSendQuota = this->_mMaxInflight;
+            this->_mTopicAliasMaximum = 0x00;
+            this->_mMaxPacketSize = 0xFFFFFFFF;
+
+            memset(&Options, 0x00, sizeof(MQTTCodec::ConnectOptions));
+            Options.ClientID = ClientID;
+            Options.CleanSession = CleanSession;
+            Options.KeepAlive = this->_mKeepAlive;
+
+            // The broker must not send packets which doesn´t fit into the receive buffer (MQTT 5 only)
+            Options.MaximumPacketSize = this->_mRxBufferSize;
 
-            // Set the will configuration
             if(Will)
             {
-                this->_copyString(Will->Topic, &Length);
-                this->_copyString(Will->Message, &Length);
+                Options.WillTopic = Will->Topic;
+                Options.WillMessage = Will->Message;
+                Options.WillQoS = Will->QoS;
+                Options.WillRetain = Will->Retain;
             }
 
-            // Set the user configuration
             if(User)
             {
-                this->_copyString(User->Name, &Length);
-
-                if(User->Password)
-                {
-                    this->_mBuffer[Length++] = (User->PasswordLength >> 0x08);
-                    this->_mBuffer[Length++] = (User->PasswordLength & 0xFF);
+                Options.UserName = User->Name;
+                Options.Password = User->Password;
+                Options.PasswordLength = User->PasswordLength;
+            }
 
-                    if((Length + User->PasswordLength) > MQTT_BUFFER_SIZE)
-                    {
-                        return BUFFER_OVERFLOW;
-                    }
+            Error = MQTTCodec::EncodeConnect(this->_mBuffer, this->_mBufferSize, this->_mVersion, Options, &Offset, &Length);
+            if(Error)
+            {
+                this->_mClient.stop();
 
-                    for(uint16_t i = 0x00; i < User->PasswordLength; i++)
-                    {
-                        this->_mBuffer[Length++] = User->Password[i];
-                    }
-                }
+                return MQTT::_codecError(Error);
             }
 
             // Transmit the buffer
-            if(this->_writeMessage(CONNECT, 0x00, Length - MQTT_FIXED_HEADER_SIZE))
+            if(this->_writePacket(Offset, Length))
             {
+                this->_mClient.stop();
+                this->_scheduleReconnect();
+
                 return TRANSMISSION_ERROR;
             }
 
-            // Wait for the broker
-            uint32_t TimeLastAction = millis();
-            while(!_mClient.available())
-            {
-                if((millis() - TimeLastAction) > (this->_mKeepAlive * 1000UL))
-                {
-                    this->_mClient.stop();
+            // The answer from the broker is processed with the next #Poll calls
+            this->_setStatus(CONNECTING, NO_ERROR);
+            this->_mConnectStart = millis();
 
-                    return TIMEOUT;
-                }
-            }
+            return NO_ERROR;
+        }
 
-            // Get the answer
-            uint16_t Temp;
-            if((this->_readMessage(&Length, &Temp)) || (this->_mBuffer[0] != (CONNACK << 0x04)))
-            {
-                return TRANSMISSION_ERROR;
-            }
+        this->_scheduleReconnect();
 
-            // Save the connection state
-            this->_mConnectionState = (MQTT::ConnectionState)this->_mBuffer[3];
+        return CLIENT_ERROR;
+    }
+    else
+    {
+        return CONNECTION_IN_USE;
+    }
+}
 
-            // ToDo: Add more detailed error message
-            if(this->_mConnectionState == ACCEPTED)
-            {
-                this->_mPingTimer->start();
+MQTT::Error MQTT::ConnectAndPublish(const char* ClientID, bool CleanSession, const MQTT::PublishMessage* Messages, uint8_t Count)
+{
+    MQTT::Error Error;
+    const uint8_t Disconnect[] = {(DISCONNECT << 0x04), 0x00};
 
-                return NO_ERROR;
-            }
+    if((Messages == NULL) && Count)
+    {
+        return INVALID_PARAMETER;
+    }
 
-            return HOST_UNREACHABLE;
+    // Queue the connection request, all messages and the disconnect and transmit them in one flight.
+    // The connection is closed before the CONNACK arrives, so the session can´t be continued.
+    this->Cork();
+    this->_mPipelined = true;
+
+    Error = this->BeginConnect(ClientID, CleanSession, NULL, NULL);
+    if(Error)
+    {
+        this->_mCorked = false;
+        this->_mCorkLength = 0x00;
+        this->_mReconnectPending = false;
+        this->_mPipelined = false;
+
+        return Error;
+    }
+
+    for(uint8_t i = 0x00; i < Count; i++)
+    {
+        if(Messages[i].Prepared != NULL)
+        {
+            Error = this->Publish(Messages[i].Prepared, Messages[i].Payload, Messages[i].Length, NULL);
+        }
+        else
+        {
+            Error = this->Publish(Messages[i].Topic, Messages[i].Payload, Messages[i].Length, NULL, QOS_0, Messages[i].Retain, false);
         }
+        if(Error)
+        {
+            break;
+        }
+    }
 
-        return CLIENT_ERROR;
+    if(Error == NO_ERROR)
+    {
+        this->_countSent(Disconnect[0]);
+        Error = this->_transmit(Disconnect, sizeof(Disconnect));
     }
-    else
+
+    if((Error != NO_ERROR) || (this->Uncork() != NO_ERROR))
     {
-        return CONNECTION_IN_USE;
+        this->_mCorked = false;
+        this->_mCorkLength = 0x00;
+        this->_mClient.stop();
+        this->_setStatus(DISCONNECTED, TRANSMISSION_ERROR);
+        this->_mReconnectPending = false;
+        this->_mPipelined = false;
+
+        return TRANSMISSION_ERROR;
+    }
+
+    // Check the answer from the broker afterwards
+    while(this->_mStatus == CONNECTING)
+    {
+        this->Poll();
     }
+
+    // The connection was closed with the disconnect already
+    this->_mPipelined = false;
+    this->_mPingTimer->stop();
+    this->_mClient.stop();
+    this->_setStatus(DISCONNECTED, this->_mConnectError);
+
+    // The connection is closed on purpose, so a failed connection is retried by the caller
+    this->_mReconnectPending = false;
+
+    return this->_mConnectError;
 }
 
 void MQTT::Disonnect(void)
 {
+    // Transmit the messages from the other threads first
+    this->_drainQueue();
+
     this->_mBuffer[0] = (DISCONNECT << 0x04);
     this->_mBuffer[1] = 0x00;
-    _mClient.write(this->_mBuffer, 0x02);
+    this->_countSent(this->_mBuffer[0]);
+    this->_transmit(this->_mBuffer, 0x02);
+
+    // Transmit all queued messages before the connection is closed
+    this->Uncork();
+
     this->_mClient.stop();
     this->_mPingTimer->stop();
+    this->_mReconnectPending = false;
+    this->_setStatus(DISCONNECTED, NO_ERROR);
+}
+
+void MQTT::Cork(void)
+{
+    this->_mCorked = true;
+}
+
+MQTT::Error MQTT::Uncork(void)
+{
+    this->_mCorked = false;
+
+    if(!this->isConnected())
+    {
+        this->_mCorkLength = 0x00;
+
+        return NOT_CONNECTED;
+    }
+
+    return this->_flush();
 }
 
 void MQTT::SetBroker(IPAddress IP)
@@ -272,100 +421,119 @@ void MQTT::SetCallback(Publish_Callback Callback)
     this->_mCallback = Callback;
 }
 
-MQTT::Error MQTT::Poll(void)
+void MQTT::SetConnectCallback(Connect_Callback Callback)
 {
-    if(!this->isConnected())
+    this->_mConnectCallback = Callback;
+}
+
+void MQTT::EnableReconnect(uint8_t Budget)
+{
+    this->_mReconnectBudget = Budget;
+    this->_mReconnectAttempt = 0x00;
+
+    if(Budget == 0x00)
     {
-        return NOT_CONNECTED;
+        this->_mReconnectPending = false;
     }
+}
+
+void MQTT::SetStatusCallback(Status_Callback Callback)
+{
+    this->_mStatusCallback = Callback;
+}
+
+void MQTT::SetSubscribeCallback(Subscribe_Callback Callback)
+{
+    this->_mSubscribeCallback = Callback;
+}
 
-    // Process the answer from the host
-    if(this->_mClient.available())
+MQTT::Error MQTT::Poll(void)
+{
+    uint16_t FixedHeaderSize;
+    uint16_t ReceivedBytes;
+
+    // Start the next reconnect attempt after the backoff
+    if(this->_mReconnectPending && (this->_mStatus == DISCONNECTED) && ((int32_t)(millis() - this->_mReconnectTime) >= 0x00))
     {
-        uint16_t FixedHeaderSize;
-        uint16_t ReceivedBytes;
+        this->_mReconnectPending = false;
 
-        if(this->_readMessage(&FixedHeaderSize, &ReceivedBytes))
+        MQTT::Error Error = this->BeginConnect(this->_mClientID, this->_mCleanSession, this->_mWill, this->_mUser);
+        if(Error)
         {
-            return TRANSMISSION_ERROR;
+            return Error;
         }
+    }
 
-        if(FixedHeaderSize)
+    // Process the remaining data when the connection was closed by the broker
+    if((!this->isConnected()) && (this->_mClient.available() <= 0x00))
+    {
+        // The connection was closed during the connection request
+        if(this->_mStatus == CONNECTING)
+        {
+            this->_finishConnect(TRANSMISSION_ERROR);
+        }
+        else if(this->_mStatus == CONNECTED)
         {
-            ControlPacket Type = (MQTT::ControlPacket)(_mBuffer[0] >> 0x04);
-            MQTT::QoS QoS = (MQTT::QoS)((_mBuffer[0] >> 0x01) & 0x03);
-            bool DUP = (bool)((_mBuffer[0] >> 0x03) & 0x01);
+            this->_linkLost(CONNECTION_LOST);
+        }
 
-            switch(Type)
-            {
-                case(PUBLISH):
-                {
-                    MQTT::Error Error = NO_ERROR;
-                    uint16_t MessageID = 0x00;
-                    uint16_t MessageIDLength = 0x00;
-                    uint16_t TopicLength = (this->_mBuffer[FixedHeaderSize] << 0x08) | this->_mBuffer[FixedHeaderSize + 0x01];
-                    uint16_t PayloadLength = ReceivedBytes - FixedHeaderSize - TopicLength - sizeof(TopicLength);
-
-                    // QoS 1 needs a PUBACK as response
-                    if(QoS == MQTT::QOS_1)
-                    {
+        return NOT_CONNECTED;
+    }
 
-                        PayloadLength -= 0x02;
-                        MessageID = (this->_mBuffer[FixedHeaderSize + TopicLength + 0x02] << 0x08) | this->_mBuffer[FixedHeaderSize + TopicLength + 0x03];
-                        MessageIDLength = sizeof(MessageID);
+    // The broker doesn´t answer the ping requests
+    if(this->_mPingTimeout.exchange(false))
+    {
+        this->_mStatistics.PingTimeouts++;
+        this->_linkLost(TIMEOUT);
 
-                        Error = this->_publishAcknowledge(MessageID);
-                    }
-                    // QoS 2 needs a PUBREC as response
-                    else if(QoS == MQTT::QOS_2)
-                    {
+        return NOT_CONNECTED;
+    }
 
-                        PayloadLength -= 0x02;
-                        MessageID = (this->_mBuffer[FixedHeaderSize + TopicLength + 0x02] << 0x08) | this->_mBuffer[FixedHeaderSize + TopicLength + 0x03];
-                        MessageIDLength = sizeof(MessageID);
+    // Transmit the messages from the other threads
+    if(this->_drainQueue())
+    {
+        return TRANSMISSION_ERROR;
+    }
 
-                        Error = this->_publishReceived(MessageID);
-                    }
+    // Process the available data from the host. Incomplete messages are continued with the next call
+    do
+    {
+        MQTT::Error Error = this->_readMessage(&FixedHeaderSize, &ReceivedBytes);
+        if(Error)
+        {
+            return Error;
+        }
 
-                    this->_mCallback(TopicLength, (char*)(&this->_mBuffer[FixedHeaderSize + sizeof(TopicLength)]), PayloadLength, (char*)(&this->_mBuffer[FixedHeaderSize + sizeof(TopicLength) + TopicLength + MessageIDLength]), MessageID, QoS, DUP);
+        if(FixedHeaderSize)
+        {
+            this->_mStatistics.PacketsReceived[this->_peek(0) >> 0x04]++;
 
-                    return Error;
-                }
-                case(PUBREC):
-                {
-                    return this->_publishRelease((this->_mBuffer[2] << 0x08) + this->_mBuffer[3]);
-                }
-                case(PUBREL):
-                {
-                    return this->_publishComplete((this->_mBuffer[2] << 0x08) + this->_mBuffer[3]);
-                }
-                case(PUBCOMP):
-                {
-                    break;
-                }
-                case(SUBACK):
-                {
-                    // Add additonal code if needed
-                    break;
-                }
-                case(UNSUBACK):
-                {
-                    // Add additonal code if needed
-                    break;
-                }
-                case(PINGREQ):
-                {
-                    // Add additonal code if needed
-                    break;
-                }
-                case(PINGRESP):
-                {
-                    this->_mWaitForHostPing = false;
+            Error = this->_processMessage(FixedHeaderSize, ReceivedBytes);
 
-                    break;
-                }
+            // Remove the message from the receive buffer
+            this->_consume(ReceivedBytes);
+
+            if(Error)
+            {
+                return Error;
             }
         }
+    } while(FixedHeaderSize);
+
+    // Abort the connection request when the broker doesn´t answer
+    if((this->_mStatus == CONNECTING) && ((millis() - this->_mConnectStart) > (this->_mKeepAlive * 1000UL)))
+    {
+        this->_mStatistics.ConnectTimeouts++;
+        this->_finishConnect(TIMEOUT);
+
+        return TIMEOUT;
+    }
+
+    // Transmit all unacknowledged messages again after a timeout
+    // NOTE: MQTT 5 only allows to resend messages after a reconnect [MQTT-4.4.0-1]
+    if((this->_mStatus == CONNECTED) && (this->_mVersion != MQTT_VERSION_5))
+    {
+        return this->_retransmit(false);
     }
 
     return NO_ERROR;
@@ -398,224 +566,1301 @@ MQTT::Error MQTT::Publish(const char* Topic, const uint8_t* Payload, uint16_t Le
 
 MQTT::Error MQTT::Publish(const char* Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP)
 {
-    uint8_t Flags = 0x00;
-    uint16_t ByteOffset = MQTT_FIXED_HEADER_SIZE;
+    const MQTT::Segment Segment = {Payload, Length};
 
-    if((Payload == NULL) || ((Length - MQTT_FIXED_HEADER_SIZE - 2) > MQTT_BUFFER_SIZE)) 
+    if(Payload == NULL)
     {
         return INVALID_PARAMETER;
     }
 
-    if(this->isConnected())
-    {
-        // Clear the buffer
-        memset(this->_mBuffer, 0x00, MQTT_BUFFER_SIZE);
+    return this->Publish(Topic, &Segment, 0x01, ID, QoS, Retain, DUP);
+}
+
+MQTT::Error MQTT::Publish(const char* Topic, const MQTT::Segment* Segments, uint8_t Count)
+{
+    return this->Publish(Topic, Segments, Count, NULL, QOS_0, false, false);
+}
 
-        // Copy the topic into the buffer
-        this->_copyString(Topic, &ByteOffset);
+MQTT::Error MQTT::Publish(const char* Topic, const MQTT::Segment* Segments, uint8_t Count, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP)
+{
+    MQTT::Error Error;
+    uint16_t Start;
+    uint16_t HeaderLength;
+    uint16_t MessageID = 0x00;
+    uint32_t Length = 0x00;
+    MQTT::Inflight* Message = NULL;
+
+    if((Topic == NULL) || ((Segments == NULL) && Count))
+    {
+        return INVALID_PARAMETER;
+    }
 
-        // Quality of service 1 and 2 need a packet identifier
-        if((QoS == MQTT::QOS_1) || (QoS == MQTT::QOS_2))
+    for(uint8_t i = 0x00; i < Count; i++)
+    {
+        if((Segments[i].Data == NULL) && Segments[i].Length)
         {
-            this->_mBuffer[ByteOffset++] = (this->_mCurrentMessageID >> 0x08);
-            this->_mBuffer[ByteOffset++] = (this->_mCurrentMessageID & 0xFF);
+            return INVALID_PARAMETER;
+        }
 
-            if(ID != NULL)
+        Length += Segments[i].Length;
+    }
+
+    if(this->_mStreamRemaining)
+    {
+        return CONNECTION_IN_USE;
+    }
+
+    if(this->isConnected())
+    {
+        // Quality of service 1 and 2 need a free entry in the in-flight window
+        if(QoS != MQTT::QOS_0)
+        {
+            Message = this->_allocateInflight();
+            if(Message == NULL)
             {
-                *ID = this->_mCurrentMessageID;
+                this->_mStatistics.InflightOverflows++;
 
-                this->_increaseID();
+                return INFLIGHT_FULL;
             }
         }
 
-        // Copy the payload into the buffer
-        for(uint16_t i = 0x00; i < Length; i++)
+        // Encode the topic and the message ID in the buffer
+        Error = this->_preparePublish(Topic, Length, &MessageID, QoS, Retain, DUP, &Start, &HeaderLength);
+        if(Error)
         {
-            this->_mBuffer[ByteOffset++] = Payload[i];
+            return Error;
         }
 
-        // Save the retain status
-        Flags |= (Retain << 0x00);
-
-        // Save the DUP status
-        Flags |= (DUP << 0x03);
-
-        // Save the quality of service
-        Flags |= (uint8_t)((QoS & 0x03) << 0x01);
+        if((ID != NULL) && (QoS != MQTT::QOS_0))
+        {
+            *ID = MessageID;
+        }
 
-        // Transmit the buffer
-        return this->_writeMessage(PUBLISH, Flags, ByteOffset - MQTT_FIXED_HEADER_SIZE);
+        return this->_transmitPublish(this->_mBuffer + Start, HeaderLength, Segments, Count, Length, Message, QoS, MessageID);
     }
 
     return NOT_CONNECTED;
 }
 
-MQTT::Error MQTT::Subscribe(const char* Topic)
-{
-    return this->Subscribe(Topic, QOS_0);
-}
-
-MQTT::Error MQTT::Subscribe(const char* Topic, MQTT::QoS QoS)
+MQTT::Error MQTT::PreparePublish(MQTT::PreparedPublish* Prepared, const char* Topic, MQTT::QoS QoS, bool Retain)
 {
-    uint16_t Length = MQTT_FIXED_HEADER_SIZE;
+    uint16_t TopicLength;
+    uint16_t Offset = MQTT_FIXED_HEADER_SIZE;
 
-    if(Topic == NULL)
+    if((Prepared == NULL) || (Topic == NULL))
     {
         return INVALID_PARAMETER;
     }
 
-    if(this->isConnected())
+    // MQTT 5 needs additional space for the property length and the topic alias
+    TopicLength = strlen(Topic);
+    if((MQTT_FIXED_HEADER_SIZE + sizeof(TopicLength) + TopicLength + sizeof(uint16_t) + ((this->_mVersion == MQTT_VERSION_5) ? 0x04 : 0x00)) > MQTT_PREPARED_BUFFER_SIZE)
     {
-        // Set the message ID
-        this->_mBuffer[Length++] = (this->_mCurrentMessageID >> 0x08);
-        this->_mBuffer[Length++] = (this->_mCurrentMessageID & 0xFF);
-        this->_increaseID();
-
-        // Copy the topic into the buffer
-        this->_copyString(Topic, &Length);
+        return BUFFER_OVERFLOW;
+    }
 
-        // Write the QoS into the buffer
-        this->_mBuffer[Length++] = (uint8_t)QoS;
+    // Encode the topic
+    MQTTCodec::EncodeString(Prepared->Packet, MQTT_PREPARED_BUFFER_SIZE, &Offset, Topic);
 
-        // Transmit the buffer
-        return this->_writeMessage(SUBSCRIBE, (0x01 << 0x01), Length - MQTT_FIXED_HEADER_SIZE);
+    // Reserve space for the message ID. The ID is set with each publish
+    if(QoS != MQTT::QOS_0)
+    {
+        Offset += sizeof(uint16_t);
+    }
+
+    Prepared->Length = Offset - MQTT_FIXED_HEADER_SIZE;
+    Prepared->Flags = (uint8_t)(Retain << 0x00) | (uint8_t)((QoS & 0x03) << 0x01);
+    Prepared->QoS = QoS;
+    Prepared->Alias = 0x00;
+    Prepared->Connection = 0x00;
+
+    // Each prepared topic gets its own topic alias. The properties are encoded with each publish
+    if((this->_mVersion == MQTT_VERSION_5) && (this->_mAliasCount < 0xFFFF))
+    {
+        Prepared->Alias = ++this->_mAliasCount;
+    }
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::Publish(MQTT::PreparedPublish* Prepared, const uint8_t* Payload, uint16_t Length, uint16_t* ID)
+{
+    const MQTT::Segment Segment = {Payload, Length};
+
+    return this->Publish(Prepared, &Segment, 0x01, ID);
+}
+
+MQTT::Error MQTT::Publish(MQTT::PreparedPublish* Prepared, const MQTT::Segment* Segments, uint8_t Count, uint16_t* ID)
+{
+    MQTT::Error Error;
+    uint16_t Start;
+    uint16_t HeaderLength;
+    bool Alias = false;
+    uint16_t MessageID = 0x00;
+    uint32_t Length = 0x00;
+    MQTT::Inflight* Message = NULL;
+
+    if((Prepared == NULL) || ((Segments == NULL) && Count))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    for(uint8_t i = 0x00; i < Count; i++)
+    {
+        if((Segments[i].Data == NULL) && Segments[i].Length)
+        {
+            return INVALID_PARAMETER;
+        }
+
+        Length += Segments[i].Length;
+    }
+
+    if(this->_mStreamRemaining)
+    {
+        return CONNECTION_IN_USE;
+    }
+
+    if(this->isConnected())
+    {
+        // Quality of service 1 and 2 need a free entry in the in-flight window and a new message ID
+        if(Prepared->QoS != MQTT::QOS_0)
+        {
+            Message = this->_allocateInflight();
+            if(Message == NULL)
+            {
+                this->_mStatistics.InflightOverflows++;
+
+                return INFLIGHT_FULL;
+            }
+
+            MessageID = this->_mCurrentMessageID;
+            this->_increaseID();
+
+            Prepared->Packet[MQTT_FIXED_HEADER_SIZE + Prepared->Length - 0x02] = (MessageID >> 0x08);
+            Prepared->Packet[MQTT_FIXED_HEADER_SIZE + Prepared->Length - 0x01] = (MessageID & 0xFF);
+
+            if(ID != NULL)
+            {
+                *ID = MessageID;
+            }
+        }
+
+        HeaderLength = Prepared->Length;
+
+        if(this->_mVersion == MQTT_VERSION_5)
+        {
+            uint8_t* Properties = Prepared->Packet + MQTT_FIXED_HEADER_SIZE + Prepared->Length;
+
+            Alias = (Prepared->Alias != 0x00) && (Prepared->Alias <= this->_mTopicAliasMaximum);
+
+            // The broker knows the alias from a previous message of this connection. Replace the topic with the alias.
+            // NOTE: QoS 1 and QoS 2 messages always carry the topic, because they can be retransmitted with a new connection!
+            if(Alias && (Prepared->QoS == MQTT::QOS_0) && (Prepared->Connection == this->_mConnections))
+            {
+                uint8_t Header[MQTT_FIXED_HEADER_SIZE + 0x06];
+                MQTTCodec::PublishOptions Options = {"", 0x00, MQTT::QOS_0, (bool)(Prepared->Flags & 0x01), false, Prepared->Alias};
+
+                Error = MQTT::_codecError(MQTTCodec::EncodePublish(Header, sizeof(Header), MQTT_VERSION_5, Options, Length, &Start, &HeaderLength));
+                if(Error)
+                {
+                    return Error;
+                }
+
+                return this->_transmitPublish(Header + Start, HeaderLength, Segments, Count, Length, NULL, MQTT::QOS_0, 0x00);
+            }
+
+            // Transmit the topic together with the alias, so the broker can learn the alias
+            HeaderLength += MQTTCodec::EncodePublishProperties(Properties, Alias ? Prepared->Alias : 0x00);
+        }
+
+        if(Length > (MQTT_MAX_REMAINING_LENGTH - HeaderLength))
+        {
+            return INVALID_PARAMETER;
+        }
+
+        // Only the remaining length has to be encoded. The topic is already stored in the packet buffer
+        Start = MQTTCodec::EncodeFixedHeader(Prepared->Packet, PUBLISH, Prepared->Flags, HeaderLength + Length);
+
+        Error = this->_transmitPublish(Prepared->Packet + Start, MQTT_FIXED_HEADER_SIZE - Start + HeaderLength, Segments, Count, Length, Message, Prepared->QoS, MessageID);
+        if((Error == NO_ERROR) && Alias)
+        {
+            Prepared->Connection = this->_mConnections;
+        }
+
+        return Error;
+    }
+
+    return NOT_CONNECTED;
+}
+
+MQTT::Error MQTT::PublishBegin(const char* Topic, uint32_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP)
+{
+    MQTT::Error Error;
+    uint16_t Start;
+    uint16_t HeaderLength;
+    uint16_t MessageID = 0x00;
+    MQTT::Inflight* Message = NULL;
+
+    if(Topic == NULL)
+    {
+        return INVALID_PARAMETER;
+    }
+
+    if(this->_mStreamRemaining)
+    {
+        return CONNECTION_IN_USE;
+    }
+
+    if(this->isConnected())
+    {
+        // Quality of service 1 and 2 need a free entry in the in-flight window
+        if(QoS != MQTT::QOS_0)
+        {
+            Message = this->_allocateInflight();
+            if(Message == NULL)
+            {
+                this->_mStatistics.InflightOverflows++;
+
+                return INFLIGHT_FULL;
+            }
+        }
+
+        // Encode the topic in the buffer
+        Error = this->_preparePublish(Topic, Length, &MessageID, QoS, Retain, DUP, &Start, &HeaderLength);
+        if(Error)
+        {
+            return Error;
+        }
+
+        // Check the maximum packet size of the broker
+        if((HeaderLength + Length) > this->_mMaxPacketSize)
+        {
+            return PACKET_TOO_LARGE;
+        }
+
+        // The streamed payload is collected in the in-flight entry for retransmissions
+        if(Message != NULL)
+        {
+            if((HeaderLength + Length) > this->_mInflightSize)
+            {
+                return BUFFER_OVERFLOW;
+            }
+
+            memcpy(Message->Packet, this->_mBuffer + Start, HeaderLength);
+            Message->Length = HeaderLength;
+            Message->ID = MessageID;
+
+            if(ID != NULL)
+            {
+                *ID = MessageID;
+            }
+        }
+
+        // Transmit the fixed header, the topic and the message ID. The payload follows with the next write calls
+        if(this->_writePacket(Start, HeaderLength))
+        {
+            return TRANSMISSION_ERROR;
+        }
+
+        this->_mStreamRemaining = Length;
+        this->_mStreamMessage = Message;
+
+        // Messages without payload are complete with the header
+        if(Length == 0x00)
+        {
+            this->_completeStream();
+        }
+
+        return NO_ERROR;
     }
 
     return NOT_CONNECTED;
 }
 
-MQTT::Error MQTT::Unsubscribe(const char* Topic)
+MQTT::Error MQTT::PublishWrite(const uint8_t* Payload, uint16_t Length)
+{
+    if((Payload == NULL) || (Length > this->_mStreamRemaining))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    if(this->_transmit(Payload, Length))
+    {
+        // The packet is incomplete and the broker will close the connection anyway
+        this->_mStreamRemaining = 0x00;
+        this->_mStreamMessage = NULL;
+        this->_mClient.stop();
+
+        return TRANSMISSION_ERROR;
+    }
+
+    if(this->_mStreamMessage != NULL)
+    {
+        memcpy(this->_mStreamMessage->Packet + this->_mStreamMessage->Length, Payload, Length);
+        this->_mStreamMessage->Length += Length;
+    }
+
+    this->_mStreamRemaining -= Length;
+
+    // The message has to wait for the acknowledge as soon as the broker has the complete packet
+    if(this->_mStreamRemaining == 0x00)
+    {
+        this->_completeStream();
+    }
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::PublishEnd(void)
+{
+    if(this->_mStreamRemaining)
+    {
+        // The broker can´t process an incomplete packet, so the connection has to be closed
+        this->_mStreamRemaining = 0x00;
+        this->_mStreamMessage = NULL;
+        this->_mClient.stop();
+
+        return INVALID_PARAMETER;
+    }
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::PublishAsync(const char* Topic, const uint8_t* Payload, uint16_t Length)
+{
+    uint32_t Position;
+    uint32_t Remaining;
+    uint16_t TopicLength;
+    uint16_t Offset = 0x00;
+    MQTT::QueueEntry* Entry;
+
+    if((Topic == NULL) || ((Payload == NULL) && Length))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    // MQTT 5 needs an additional byte for the property length
+    TopicLength = strlen(Topic);
+    Remaining = sizeof(TopicLength) + TopicLength + Length + ((this->_mVersion == MQTT_VERSION_5) ? 0x01 : 0x00);
+
+    // The fixed header uses a maximum of 3 bytes for the entry size
+    if((Remaining + 0x03) > this->_mQueueEntrySize)
+    {
+        return BUFFER_OVERFLOW;
+    }
+
+    Entry = this->_reserveQueue(&Position);
+    if(Entry == NULL)
+    {
+        this->_mQueueOverflows++;
+
+        return QUEUE_FULL;
+    }
+
+    // Encode the complete message directly in the queue entry
+    Entry->Data[Offset++] = (PUBLISH << 0x04);
+    Offset += MQTTCodec::EncodeLength(Entry->Data + Offset, Remaining);
+    MQTTCodec::EncodeString(Entry->Data, this->_mQueueEntrySize, &Offset, Topic);
+
+    if(this->_mVersion == MQTT_VERSION_5)
+    {
+        Offset += MQTTCodec::EncodePublishProperties(Entry->Data + Offset, 0x00);
+    }
+
+    memcpy(Entry->Data + Offset, Payload, Length);
+    Offset += Length;
+
+    this->_commitQueue(Entry, Offset, Position);
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::Subscribe(const char* Topic)
+{
+    return this->Subscribe(Topic, QOS_0);
+}
+
+MQTT::Error MQTT::Subscribe(const char* Topic, MQTT::QoS QoS)
+{
+    const MQTT::Subscription Subscription = {Topic, (uint8_t)QoS};
+
+    return this->Subscribe(&Subscription, 0x01, NULL);
+}
+
+MQTT::Error MQTT::Subscribe(const MQTT::Subscription* Subscriptions, uint8_t Count, uint16_t* ID)
+{
+    uint8_t Added = 0x00;
+
+    if((Subscriptions == NULL) || (Count == 0x00))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    // The client can´t process more return codes
+    if(Count > MQTT_MAX_SUBSCRIPTIONS)
+    {
+        return BUFFER_OVERFLOW;
+    }
+
+    // Count the new topics for the list for the reconnect
+    for(uint8_t i = 0x00; i < Count; i++)
+    {
+        uint8_t Index;
+
+        if(Subscriptions[i].Topic == NULL)
+        {
+            return INVALID_PARAMETER;
+        }
+
+        for(Index = 0x00; Index < this->_mSubscriptionCount; Index++)
+        {
+            if(!strcmp(this->_mSubscriptions[Index].Topic, Subscriptions[i].Topic))
+            {
+                break;
+            }
+        }
+
+        if(Index == this->_mSubscriptionCount)
+        {
+            Added++;
+        }
+    }
+
+    if((this->_mSubscriptionCount + Added) > MQTT_MAX_SUBSCRIPTIONS)
+    {
+        return BUFFER_OVERFLOW;
+    }
+
+    MQTT::Error Error = this->_sendSubscribe(Subscriptions, Count, ID);
+    if(Error)
+    {
+        return Error;
+    }
+
+    // Add the topics to the list or update the QoS of known topics
+    for(uint8_t i = 0x00; i < Count; i++)
+    {
+        uint8_t Index;
+
+        for(Index = 0x00; Index < this->_mSubscriptionCount; Index++)
+        {
+            if(!strcmp(this->_mSubscriptions[Index].Topic, Subscriptions[i].Topic))
+            {
+                break;
+            }
+        }
+
+        this->_mSubscriptions[Index] = Subscriptions[i];
+        if(Index == this->_mSubscriptionCount)
+        {
+            this->_mSubscriptionCount++;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::Unsubscribe(const char* Topic)
+{
+    return this->Unsubscribe(&Topic, 0x01, NULL);
+}
+
+MQTT::Error MQTT::Unsubscribe(const char* const* Topics, uint8_t Count, uint16_t* ID)
+{
+    MQTTCodec::Error Error;
+    uint16_t Start;
+    uint16_t Length;
+
+    if((Topics == NULL) || (Count == 0x00))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    // The client can´t process more reason codes
+    if(Count > MQTT_MAX_SUBSCRIPTIONS)
+    {
+        return BUFFER_OVERFLOW;
+    }
+
+    if(this->isConnected())
+    {
+        if(this->_mPendingCount == MQTT_MAX_PENDING_REQUESTS)
+        {
+            return INFLIGHT_FULL;
+        }
+
+        Error = MQTTCodec::EncodeUnsubscribe(this->_mBuffer, this->_mBufferSize, this->_mVersion, this->_mCurrentMessageID, Topics, Count, &Start, &Length);
+        if(Error)
+        {
+            return MQTT::_codecError(Error);
+        }
+
+        if(ID != NULL)
+        {
+            *ID = this->_mCurrentMessageID;
+        }
+
+        // Only MQTT 5 brokers answer with a reason code for each topic
+        this->_mPendingRequests[this->_mPendingCount++] = {this->_mCurrentMessageID, UNSUBACK, (this->_mVersion == MQTT_VERSION_5) ? Count : (uint8_t)0x00};
+        this->_increaseID();
+
+        // Transmit the buffer
+        if(this->_writePacket(Start, Length))
+        {
+            return TRANSMISSION_ERROR;
+        }
+
+        // Remove the subscriptions from the list for the reconnect
+        for(uint8_t t = 0x00; t < Count; t++)
+        {
+            for(uint8_t i = 0x00; i < this->_mSubscriptionCount; i++)
+            {
+                if(!strcmp(this->_mSubscriptions[i].Topic, Topics[t]))
+                {
+                    this->_mSubscriptions[i] = this->_mSubscriptions[--this->_mSubscriptionCount];
+
+                    break;
+                }
+            }
+        }
+
+        return NO_ERROR;
+    }
+
+    return NOT_CONNECTED;
+}
+
+MQTT::Error MQTT::_readMessage(uint16_t* FixedHeaderSize, uint16_t* Bytes)
+{
+    *FixedHeaderSize = 0x00;
+    *Bytes = 0x00;
+
+    // Move all available bytes from the TCP client into the receive buffer
+    this->_fillBuffer();
+
+    while(true)
+    {
+        switch(this->_mRxState)
+        {
+            case(RX_FIXED_HEADER):
+            {
+                MQTTCodec::FixedHeader Header;
+
+                // Decode the remaining length. Wait for more data when the fixed header is incomplete
+                MQTTCodec::Error Error = MQTTCodec::DecodeFixedHeader(this->_reader(this->_mRxCount), &Header);
+                if(Error == MQTTCodec::INCOMPLETE)
+                {
+                    return NO_ERROR;
+                }
+                else if(Error)
+                {
+                    this->_mRxCount = 0x00;
+                    this->_mClient.stop();
+
+                    return TRANSMISSION_ERROR;
+                }
+
+                this->_mRxHeaderSize = Header.Size;
+                this->_mRxRemaining = Header.RemainingLength;
+
+                // Skip messages that doesn´t fit into the receive buffer
+                if((this->_mRxHeaderSize + this->_mRxRemaining) > this->_mRxBufferSize)
+                {
+                    this->_mStatistics.RxOverflows++;
+                    this->_consume(this->_mRxHeaderSize);
+                    this->_mRxState = RX_DISCARD;
+                }
+                else
+                {
+                    this->_mRxState = RX_BODY;
+                }
+
+                break;
+            }
+            case(RX_BODY):
+            {
+                if(this->_mRxCount < (this->_mRxHeaderSize + this->_mRxRemaining))
+                {
+                    return NO_ERROR;
+                }
+
+                // The message is complete and can be processed directly from the receive buffer
+                this->_mRxState = RX_FIXED_HEADER;
+                *FixedHeaderSize = this->_mRxHeaderSize;
+                *Bytes = this->_mRxHeaderSize + this->_mRxRemaining;
+
+                return NO_ERROR;
+            }
+            case(RX_DISCARD):
+            {
+                uint16_t Length = (this->_mRxCount < this->_mRxRemaining) ? this->_mRxCount : this->_mRxRemaining;
+
+                this->_consume(Length);
+                this->_mRxRemaining -= Length;
+
+                if(this->_mRxRemaining)
+                {
+                    // Make room for the next bytes of the skipped message
+                    this->_fillBuffer();
+
+                    if(!this->_mRxCount)
+                    {
+                        return NO_ERROR;
+                    }
+
+                    break;
+                }
+
+                this->_mRxState = RX_FIXED_HEADER;
+
+                return BUFFER_OVERFLOW;
+            }
+        }
+    }
+}
+
+void MQTT::_fillBuffer(void)
+{
+    int Available;
+
+    while((this->_mRxCount < this->_mRxBufferSize) && ((Available = this->_mClient.available()) > 0x00))
+    {
+        uint16_t Head = (this->_mRxTail + this->_mRxCount) & (this->_mRxBufferSize - 0x01);
+        uint16_t Length = this->_mRxBufferSize - this->_mRxCount;
+
+        // Read until the end of the buffer. The remaining bytes are read with the next cycle
+        if(Length > (this->_mRxBufferSize - Head))
+        {
+            Length = this->_mRxBufferSize - Head;
+        }
+
+        if(Length > Available)
+        {
+            Length = Available;
+        }
+
+        int Read = this->_mClient.read(this->_mRxBuffer + Head, Length);
+        if(Read <= 0x00)
+        {
+            break;
+        }
+
+        this->_mRxCount += Read;
+        this->_mStatistics.BytesReceived += Read;
+    }
+}
+
+uint8_t MQTT::_peek(uint16_t Offset) const
+{
+    return this->_mRxBuffer[(this->_mRxTail + Offset) & (this->_mRxBufferSize - 0x01)];
+}
+
+void MQTT::_view(uint16_t Offset, uint16_t Length, MQTT::View* View) const
+{
+    uint16_t Start = (this->_mRxTail + Offset) & (this->_mRxBufferSize - 0x01);
+
+    View->First = (const char*)(this->_mRxBuffer + Start);
+
+    if((Start + Length) > this->_mRxBufferSize)
+    {
+        View->FirstLength = this->_mRxBufferSize - Start;
+        View->Second = (const char*)this->_mRxBuffer;
+        View->SecondLength = Length - View->FirstLength;
+    }
+    else
+    {
+        View->FirstLength = Length;
+        View->Second = NULL;
+        View->SecondLength = 0x00;
+    }
+}
+
+void MQTT::_consume(uint16_t Length)
+{
+    this->_mRxTail = (this->_mRxTail + Length) & (this->_mRxBufferSize - 0x01);
+    this->_mRxCount -= Length;
+}
+
+MQTTCodec::Reader MQTT::_reader(uint16_t Length) const
+{
+    MQTTCodec::Reader Reader;
+
+    Reader.Buffer = this->_mRxBuffer;
+    Reader.Start = this->_mRxTail;
+    Reader.Mask = this->_mRxBufferSize - 0x01;
+    Reader.Length = Length;
+
+    return Reader;
+}
+
+bool MQTT::_acknowledgeFailed(const MQTTCodec::Ack& Ack)
+{
+    if(this->_mVersion != MQTT_VERSION_5)
+    {
+        return false;
+    }
+
+    this->_mReasonCode = (MQTT::ReasonCode)Ack.ReasonCode;
+
+    return this->_mReasonCode >= REASON_UNSPECIFIED_ERROR;
+}
+
+MQTT::Error MQTT::_codecError(MQTTCodec::Error Error)
+{
+    switch(Error)
+    {
+        case(MQTTCodec::NO_ERROR):
+        {
+            return NO_ERROR;
+        }
+        case(MQTTCodec::INVALID_PARAMETER):
+        {
+            return INVALID_PARAMETER;
+        }
+        case(MQTTCodec::BUFFER_OVERFLOW):
+        {
+            return BUFFER_OVERFLOW;
+        }
+        default:
+        {
+            return TRANSMISSION_ERROR;
+        }
+    }
+}
+
+MQTT::ConnectionState MQTT::_connectionState(uint8_t Reason)
+{
+    switch(Reason)
+    {
+        case(REASON_SUCCESS):
+        {
+            return ACCEPTED;
+        }
+        case(REASON_UNSUPPORTED_PROTOCOL):
+        {
+            return UNACCEPTABLE_PROCOTOL;
+        }
+        case(REASON_CLIENT_ID_NOT_VALID):
+        {
+            return ID_REJECT;
+        }
+        case(REASON_BAD_USER_PASSWORD):
+        {
+            return BAD_USER_PASSWORD;
+        }
+        // The broker can accept the client later
+        case(REASON_UNSPECIFIED_ERROR):
+        case(REASON_IMPLEMENTATION_SPECIFIC):
+        case(REASON_SERVER_UNAVAILABLE):
+        case(REASON_SERVER_BUSY):
+        case(REASON_QUOTA_EXCEEDED):
+        case(REASON_CONNECTION_RATE_EXCEEDED):
+        {
+            return SERVER_UNAVAILALE;
+        }
+        default:
+        {
+            return NOT_AUTHORIZED;
+        }
+    }
+}
+
+MQTT::Error MQTT::_processMessage(uint16_t FixedHeaderSize, uint16_t Bytes)
+{
+    const MQTTCodec::Reader Reader = this->_reader(Bytes);
+    ControlPacket Type = (MQTT::ControlPacket)(this->_peek(0) >> 0x04);
+    MQTTCodec::Ack Ack;
+
+    // The broker has to answer the connection request with a CONNACK first
+    if((this->_mStatus == CONNECTING) && (Type != CONNACK))
+    {
+        this->_finishConnect(TRANSMISSION_ERROR);
+
+        return TRANSMISSION_ERROR;
+    }
+
+    switch(Type)
+    {
+        case(CONNACK):
+        {
+            if(this->_mStatus != CONNECTING)
+            {
+                break;
+            }
+
+            MQTTCodec::Connack Connack;
+
+            if(MQTTCodec::DecodeConnack(Reader, this->_mVersion, FixedHeaderSize, &Connack))
+            {
+                this->_finishConnect(TRANSMISSION_ERROR);
+
+                return TRANSMISSION_ERROR;
+            }
+
+            // Save the connection state and the session present flag
+            this->_mConnectionState = (MQTT::ConnectionState)Connack.ReturnCode;
+            this->_mSessionPresent = Connack.SessionPresent;
+
+            // MQTT 5 uses reason codes and reports the limits of the broker with properties
+            if(this->_mVersion == MQTT_VERSION_5)
+            {
+                this->_mReasonCode = (MQTT::ReasonCode)Connack.ReturnCode;
+                this->_mConnectionState = MQTT::_connectionState(Connack.ReturnCode);
+                this->_mSendQuota = (Connack.ReceiveMaximum < this->_mMaxInflight) ? Connack.ReceiveMaximum : this->_mMaxInflight;
+                this->_mTopicAliasMaximum = Connack.TopicAliasMaximum;
+                this->_mMaxPacketSize = Connack.MaximumPacketSize;
+            }
+
+            // ToDo: Add more detailed error message
+            if(this->_mConnectionState == ACCEPTED)
+            {
+                MQTT::_addSample(&this->_mStatistics.Connect, millis() - this->_mConnectStart);
+                this->_finishConnect(NO_ERROR);
+
+                break;
+            }
+
+            this->_finishConnect(HOST_UNREACHABLE);
+
+            return HOST_UNREACHABLE;
+        }
+        case(PUBLISH):
+        {
+            MQTT::Error Error = NO_ERROR;
+            MQTT::View Topic;
+            MQTT::View Payload;
+            MQTTCodec::PublishInfo Publish;
+
+            if(MQTTCodec::DecodePublish(Reader, this->_mVersion, FixedHeaderSize, &Publish))
+            {
+                return TRANSMISSION_ERROR;
+            }
+
+            // QoS 1 needs a PUBACK as response
+            if(Publish.QoS == MQTT::QOS_1)
+            {
+                Error = this->_publishAcknowledge(Publish.ID);
+            }
+            // QoS 2 needs a PUBREC as response
+            else if(Publish.QoS == MQTT::QOS_2)
+            {
+                Error = this->_publishReceived(Publish.ID);
+            }
+
+            if(this->_mCallback != NULL)
+            {
+                this->_view(Publish.TopicOffset, Publish.TopicLength, &Topic);
+                this->_view(Publish.PayloadOffset, Bytes - Publish.PayloadOffset, &Payload);
+                this->_mCallback(&Topic, &Payload, Publish.ID, (MQTT::QoS)Publish.QoS, Publish.DUP);
+            }
+
+            return Error;
+        }
+        case(PUBACK):
+        {
+            if(MQTTCodec::DecodeAck(Reader, this->_mVersion, FixedHeaderSize, &Ack))
+            {
+                return TRANSMISSION_ERROR;
+            }
+
+            MQTT::Inflight* Message = this->_findInflight(Ack.ID, INFLIGHT_PUBACK);
+
+            // The message is finished even when the broker has rejected it
+            this->_acknowledgeFailed(Ack);
+
+            if(Message != NULL)
+            {
+                // Ignore retransmitted messages, because the acknowledge can belong to any transmission
+                if(Message->Retries == 0x00)
+                {
+                    MQTT::_addSample(&this->_mStatistics.Publish, millis() - Message->Sent);
+                }
+
+                Message->State = INFLIGHT_FREE;
+            }
+
+            break;
+        }
+        case(PUBREC):
+        {
+            if(MQTTCodec::DecodeAck(Reader, this->_mVersion, FixedHeaderSize, &Ack))
+            {
+                return TRANSMISSION_ERROR;
+            }
+
+            // The message was received by the broker. Release the message and wait for the PUBCOMP
+            MQTT::Inflight* Message = this->_findInflight(Ack.ID, INFLIGHT_PUBREC);
+
+            // A rejected message is finished without a release
+            if(this->_acknowledgeFailed(Ack))
+            {
+                if(Message != NULL)
+                {
+                    Message->State = INFLIGHT_FREE;
+                }
+
+                break;
+            }
+
+            if(Message != NULL)
+            {
+                Message->State = INFLIGHT_PUBCOMP;
+                Message->Timestamp = millis();
+            }
+
+            return this->_publishRelease(Ack.ID);
+        }
+        case(PUBREL):
+        {
+            if(MQTTCodec::DecodeAck(Reader, this->_mVersion, FixedHeaderSize, &Ack))
+            {
+                return TRANSMISSION_ERROR;
+            }
+
+            return this->_publishComplete(Ack.ID);
+        }
+        case(PUBCOMP):
+        {
+            if(MQTTCodec::DecodeAck(Reader, this->_mVersion, FixedHeaderSize, &Ack))
+            {
+                return TRANSMISSION_ERROR;
+            }
+
+            MQTT::Inflight* Message = this->_findInflight(Ack.ID, INFLIGHT_PUBCOMP);
+
+            this->_acknowledgeFailed(Ack);
+
+            if(Message != NULL)
+            {
+                if(Message->Retries == 0x00)
+                {
+                    MQTT::_addSample(&this->_mStatistics.Publish, millis() - Message->Sent);
+                }
+
+                Message->State = INFLIGHT_FREE;
+            }
+
+            break;
+        }
+        case(SUBACK):
+        case(UNSUBACK):
+        {
+            uint16_t ID;
+            uint8_t Count;
+            uint8_t ReturnCodes[MQTT_MAX_SUBSCRIPTIONS];
+
+            // Pass the return codes for each topic filter of the request to the application
+            if(MQTTCodec::DecodeSubscribeAck(Reader, this->_mVersion, FixedHeaderSize, &ID, ReturnCodes, sizeof(ReturnCodes), &Count))
+            {
+                return TRANSMISSION_ERROR;
+            }
+
+            // Ignore acknowledges without a matching request
+            if(!this->_completeRequest(Type, ID, Count))
+            {
+                break;
+            }
+
+            if(this->_mSubscribeCallback != NULL)
+            {
+                this->_mSubscribeCallback(ID, ReturnCodes, Count);
+            }
+
+            break;
+        }
+        case(PINGREQ):
+        {
+            // Add additonal code if needed
+            break;
+        }
+        case(PINGRESP):
+        {
+            if(this->_mWaitForHostPing)
+            {
+                MQTT::_addSample(&this->_mStatistics.Ping, millis() - this->_mPingStart);
+            }
+
+            this->_mWaitForHostPing = false;
+
+            break;
+        }
+        case(DISCONNECT):
+        {
+            // MQTT 5 brokers can close the connection with a reason code
+            if(Bytes > FixedHeaderSize)
+            {
+                this->_mReasonCode = (MQTT::ReasonCode)this->_peek(FixedHeaderSize);
+            }
+
+            this->_linkLost(CONNECTION_LOST);
+
+            return CONNECTION_LOST;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::_writePacket(uint16_t Start, uint16_t Length)
+{
+    this->_countSent(this->_mBuffer[Start]);
+
+    return this->_transmit(this->_mBuffer + Start, Length);
+}
+
+MQTT::Error MQTT::_transmit(const uint8_t* Data, uint32_t Length)
+{
+    if(!this->_mCorked)
+    {
+        return this->_write(Data, Length);
+    }
+
+    // Queue the data in the staging buffer and transmit the buffer when it is full
+    while(Length)
+    {
+        uint16_t Free = this->_mCorkBufferSize - this->_mCorkLength;
+        uint16_t Chunk = (Length > Free) ? Free : Length;
+
+        memcpy(this->_mCorkBuffer + this->_mCorkLength, Data, Chunk);
+        this->_mCorkLength += Chunk;
+        Data += Chunk;
+        Length -= Chunk;
+
+        if(this->_mCorkLength == this->_mCorkBufferSize)
+        {
+            MQTT::Error Error = this->_flush();
+            if(Error)
+            {
+                return Error;
+            }
+        }
+    }
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::_write(const uint8_t* Data, uint32_t Length)
+{
+    while(Length)
+    {
+        uint16_t Chunk = (Length > MQTT_CHUNK_SIZE) ? MQTT_CHUNK_SIZE : Length;
+
+        if(this->_mClient.write(Data, Chunk) != Chunk)
+        {
+            return TRANSMISSION_ERROR;
+        }
+
+        this->_mStatistics.BytesSent += Chunk;
+        this->_mLastTransmit = millis();
+
+        Data += Chunk;
+        Length -= Chunk;
+    }
+
+    return NO_ERROR;
+}
+
+MQTT::Error MQTT::_flush(void)
 {
-    uint16_t Length = MQTT_FIXED_HEADER_SIZE;
+    uint16_t Length = this->_mCorkLength;
 
-    if(Topic == NULL)
+    if(!Length)
     {
-        return INVALID_PARAMETER;
+        return NO_ERROR;
     }
 
-    if(this->isConnected())
+    this->_mCorkLength = 0x00;
+
+    if(this->_mClient.write(this->_mCorkBuffer, Length) != Length)
     {
-        // Set the message ID
-        this->_mBuffer[Length++] = (this->_mCurrentMessageID >> 0x08);
-        this->_mBuffer[Length++] = (this->_mCurrentMessageID & 0xFF);
-        this->_increaseID();
+        return TRANSMISSION_ERROR;
+    }
 
-        // Copy the topic into the buffer
-        this->_copyString(Topic, &Length);
+    this->_mStatistics.BytesSent += Length;
+    this->_mLastTransmit = millis();
 
-        // Transmit the buffer
-        if(this->_writeMessage(UNSUBSCRIBE, (0x01 << 0x01), Length - MQTT_FIXED_HEADER_SIZE))
+    return NO_ERROR;
+}
+
+MQTT::QueueEntry* MQTT::_reserveQueue(uint32_t* Position)
+{
+    uint32_t Head = this->_mQueueHead.load(std::memory_order_relaxed);
+
+    while(true)
+    {
+        MQTT::QueueEntry* Entry = &this->_mQueue[Head & (this->_mQueueSize - 0x01)];
+        int32_t Difference = (int32_t)(Entry->Sequence.load(std::memory_order_acquire) - Head);
+
+        // The entry is free. Try to claim it before another thread does
+        if(Difference == 0x00)
         {
-            return TRANSMISSION_ERROR;
-        }
+            if(this->_mQueueHead.compare_exchange_weak(Head, Head + 0x01, std::memory_order_relaxed))
+            {
+                *Position = Head;
 
-        return NO_ERROR;
+                return Entry;
+            }
+        }
+        // The entry wasn´t transmitted by the network task yet
+        else if(Difference < 0x00)
+        {
+            return NULL;
+        }
+        // Another thread has claimed the entry
+        else
+        {
+            Head = this->_mQueueHead.load(std::memory_order_relaxed);
+        }
     }
-
-    return NOT_CONNECTED;
 }
 
-uint8_t MQTT::_readByte(void)
+void MQTT::_commitQueue(MQTT::QueueEntry* Entry, uint16_t Length, uint32_t Position)
 {
-    while(!this->_mClient.available());
-    return this->_mClient.read();
+    Entry->Length = Length;
+    Entry->Sequence.store(Position + 0x01, std::memory_order_release);
 }
 
-MQTT::Error MQTT::_readMessage(uint16_t* FixedHeaderSize, uint16_t* Bytes)
+MQTT::Error MQTT::_enqueue(const uint8_t* Data, uint16_t Length)
 {
-    uint8_t EncodedByte = 0x00;
-    uint16_t ReceivedBytes = 0x00;
-    uint16_t RemainingLength = 0x00;
-    uint32_t Packet = 0x01;
+    uint32_t Position;
+    MQTT::QueueEntry* Entry;
 
-    // Get the fixed header
-    this->_mBuffer[ReceivedBytes++] = this->_readByte();
-    do
-    {
-        EncodedByte = this->_readByte();
-        this->_mBuffer[ReceivedBytes++] = EncodedByte;
-        RemainingLength += (EncodedByte & 0x7F) * Packet;
-        Packet <<= 0x07;
-    } while(EncodedByte & (0x01 << 0x07));
-    *FixedHeaderSize = ReceivedBytes;
-
-    if((ReceivedBytes + RemainingLength) > MQTT_BUFFER_SIZE)
+    if(Length > this->_mQueueEntrySize)
     {
         return BUFFER_OVERFLOW;
     }
 
-    // Get the remaining message
-    for(uint16_t i = 0x00; i < RemainingLength; i++)
+    Entry = this->_reserveQueue(&Position);
+    if(Entry == NULL)
     {
-        this->_mBuffer[ReceivedBytes++] = this->_readByte();
+        this->_mQueueOverflows++;
+
+        return QUEUE_FULL;
     }
 
-    *Bytes = ReceivedBytes;
+    memcpy(Entry->Data, Data, Length);
+    this->_commitQueue(Entry, Length, Position);
 
     return NO_ERROR;
 }
 
-MQTT::Error MQTT::_writeMessage(MQTT::ControlPacket ControlPacket, uint8_t Flags, uint16_t Length)
+MQTT::Error MQTT::_drainQueue(void)
 {
-    uint16_t Remaining = Length;
-    uint8_t EncodedBytes[4];
-    uint8_t SizeBytes = 0x00;
-    uint8_t TransmissionLength = 0x00;
+    MQTT::Error Error = NO_ERROR;
 
-    // Encode the length of the message
-    do
+    while(true)
     {
-        uint8_t EncodedByte = Remaining % 0x80;
-        Remaining = Remaining >> 0x07;
-        if(Remaining > 0x00)
+        MQTT::QueueEntry* Entry = &this->_mQueue[this->_mQueueTail & (this->_mQueueSize - 0x01)];
+
+        // The next entry isn´t committed yet
+        if((int32_t)(Entry->Sequence.load(std::memory_order_acquire) - (this->_mQueueTail + 0x01)) < 0x00)
+        {
+            return Error;
+        }
+
+        // The broker has to answer the ping from the transmission of the request
+        if(Entry->Data[0] == (PINGREQ << 0x04))
+        {
+            this->_mPingStart = millis();
+            this->_mWaitForHostPing = true;
+            this->_mPingQueued = false;
+        }
+
+        this->_countSent(Entry->Data[0]);
+        if(this->_transmit(Entry->Data, Entry->Length))
         {
-            EncodedByte |= 0x80;
+            Error = TRANSMISSION_ERROR;
         }
 
-        EncodedBytes[SizeBytes++] = EncodedByte;
-    } while(Remaining > 0x00);
+        // Release the entry for the producers
+        Entry->Sequence.store(this->_mQueueTail + this->_mQueueSize, std::memory_order_release);
+        this->_mQueueTail++;
+    }
+}
 
-    // Store the header and the flags for the fixed header
-    this->_mBuffer[MQTT_FIXED_HEADER_SIZE - SizeBytes - 0x01] = (ControlPacket << 0x04) | (Flags & 0x0F);
+MQTT::Error MQTT::_preparePublish(const char* Topic, uint32_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP, uint16_t* Start, uint16_t* HeaderLength)
+{
+    MQTTCodec::Error Error;
+    MQTTCodec::PublishOptions Options = {Topic, this->_mCurrentMessageID, (uint8_t)QoS, Retain, DUP, 0x00};
 
-    // Copy the encoded length
-    for(uint8_t i = 0x00; i < SizeBytes; i++)
+    // Copy the topic and the message ID into the buffer
+    Error = MQTTCodec::EncodePublish(this->_mBuffer, this->_mBufferSize, this->_mVersion, Options, Length, Start, HeaderLength);
+    if(Error)
     {
-        this->_mBuffer[MQTT_FIXED_HEADER_SIZE - SizeBytes + i] = EncodedBytes[i];
+        return MQTT::_codecError(Error);
     }
 
-    TransmissionLength = Length + SizeBytes + 0x01;
-    if(_mClient.write(this->_mBuffer + (MQTT_FIXED_HEADER_SIZE - SizeBytes - 0x01), TransmissionLength) != TransmissionLength)
+    // Quality of service 1 and 2 need a packet identifier
+    if((QoS == MQTT::QOS_1) || (QoS == MQTT::QOS_2))
     {
-        return TRANSMISSION_ERROR;
+        if(ID != NULL)
+        {
+            *ID = this->_mCurrentMessageID;
+        }
+
+        this->_increaseID();
     }
 
     return NO_ERROR;
 }
 
-MQTT::Error MQTT::_publishAcknowledge(uint16_t ID)
+MQTT::Error MQTT::_transmitPublish(const uint8_t* Header, uint16_t HeaderLength, const MQTT::Segment* Segments, uint8_t Count, uint32_t Length, MQTT::Inflight* Message, MQTT::QoS QoS, uint16_t ID)
 {
-    uint8_t Temp[4];
-
-    if(!this->isConnected())
+    // The broker doesn´t accept packets above its maximum packet size
+    if((HeaderLength + Length) > this->_mMaxPacketSize)
     {
-        return NOT_CONNECTED;
+        return PACKET_TOO_LARGE;
     }
 
-    Temp[0] = (PUBACK << 0x04);
-    Temp[1] = 0x02;
-    Temp[2] = (ID >> 0x08);
-    Temp[3] = (ID & 0xFF);
+    // Store a copy of the complete message for retransmissions
+    if(Message != NULL)
+    {
+        if((HeaderLength + Length) > this->_mInflightSize)
+        {
+            return BUFFER_OVERFLOW;
+        }
+
+        memcpy(Message->Packet, Header, HeaderLength);
+        Message->Length = HeaderLength;
+
+        for(uint8_t i = 0x00; i < Count; i++)
+        {
+            memcpy(Message->Packet + Message->Length, Segments[i].Data, Segments[i].Length);
+            Message->Length += Segments[i].Length;
+        }
+
+        Message->ID = ID;
+        Message->State = (QoS == MQTT::QOS_1) ? INFLIGHT_PUBACK : INFLIGHT_PUBREC;
+        Message->Timestamp = millis();
+        Message->Sent = Message->Timestamp;
+        Message->Retries = 0x00;
+    }
 
-    if(this->_mClient.write(Temp, sizeof(Temp)) != sizeof(Temp))
+    // Transmit the fixed header, the topic and the message ID.
+    // NOTE: Unacknowledged messages are transmitted again after a timeout or a reconnect.
+    this->_countSent(Header[0]);
+    if(this->_transmit(Header, HeaderLength))
     {
         return TRANSMISSION_ERROR;
     }
 
+    // Pass each payload segment directly to the client
+    for(uint8_t i = 0x00; i < Count; i++)
+    {
+        if(this->_transmit(Segments[i].Data, Segments[i].Length))
+        {
+            return TRANSMISSION_ERROR;
+        }
+    }
+
     return NO_ERROR;
 }
 
-MQTT::Error MQTT::_publishReceived(uint16_t ID)
+MQTT::Error MQTT::_publishAcknowledge(uint16_t ID)
 {
     uint8_t Temp[4];
 
@@ -624,20 +1869,13 @@ MQTT::Error MQTT::_publishReceived(uint16_t ID)
         return NOT_CONNECTED;
     }
 
-    Temp[0] = (PUBREC << 0x04);
-    Temp[1] = 0x02;
-    Temp[2] = (ID >> 0x08);
-    Temp[3] = (ID & 0xFF);
-                        
-    if(this->_mClient.write(Temp, sizeof(Temp)) != sizeof(Temp))
-    {
-        return TRANSMISSION_ERROR;
-    }
+    MQTTCodec::EncodeAck(Temp, PUBACK, ID);
+    this->_countSent(Temp[0]);
 
-    return NO_ERROR;
+    return this->_transmit(Temp, sizeof(Temp));
 }
 
-MQTT::Error MQTT::_publishRelease(uint16_t ID)
+MQTT::Error MQTT::_publishReceived(uint16_t ID)
 {
     uint8_t Temp[4];
 
@@ -646,17 +1884,25 @@ MQTT::Error MQTT::_publishRelease(uint16_t ID)
         return NOT_CONNECTED;
     }
 
-    Temp[0] = (PUBREL << 0x04) | (0x01 << 0x01);
-    Temp[1] = 0x02;
-    Temp[2] = (ID >> 0x08);
-    Temp[3] = (ID & 0xFF);
+    MQTTCodec::EncodeAck(Temp, PUBREC, ID);
+    this->_countSent(Temp[0]);
+
+    return this->_transmit(Temp, sizeof(Temp));
+}
+
+MQTT::Error MQTT::_publishRelease(uint16_t ID)
+{
+    uint8_t Temp[4];
 
-    if(this->_mClient.write(Temp, sizeof(Temp)) != sizeof(Temp))
+    if(!this->isConnected())
     {
-        return TRANSMISSION_ERROR;
+        return NOT_CONNECTED;
     }
 
-    return NO_ERROR;
+    MQTTCodec::EncodeAck(Temp, PUBREL, ID);
+    this->_countSent(Temp[0]);
+
+    return this->_transmit(Temp, sizeof(Temp));
 }
 
 MQTT::Error MQTT::_publishComplete(uint16_t ID)
@@ -668,17 +1914,10 @@ MQTT::Error MQTT::_publishComplete(uint16_t ID)
         return NOT_CONNECTED;
     }
 
-    Temp[0] = (PUBCOMP << 0x04) | (0x01 << 0x01);
-    Temp[1] = 0x02;
-    Temp[2] = (ID >> 0x08);
-    Temp[3] = (ID & 0xFF);
-
-    if(this->_mClient.write(Temp, sizeof(Temp)) != sizeof(Temp))
-    {
-        return TRANSMISSION_ERROR;
-    }
+    MQTTCodec::EncodeAck(Temp, PUBCOMP, ID);
+    this->_countSent(Temp[0]);
 
-    return NO_ERROR;
+    return this->_transmit(Temp, sizeof(Temp));
 }
 
 void MQTT::_init(IPAddress IP, uint16_t Port, uint16_t KeepAlive, Publish_Callback Callback)
@@ -687,60 +1926,374 @@ void MQTT::_init(IPAddress IP, uint16_t Port, uint16_t KeepAlive, Publish_Callba
     this->_mPort = Port;
     this->_mKeepAlive = KeepAlive;
     this->_mCallback = Callback;
+    this->_mConnectCallback = NULL;
+    this->_mStatusCallback = NULL;
+    this->_mSubscribeCallback = NULL;
+    this->_mClientID = NULL;
+    this->_mCleanSession = true;
+    this->_mWill = NULL;
+    this->_mUser = NULL;
+    this->_mSessionPresent = false;
+    this->_mReconnectPending = false;
+    this->_mReconnectBudget = 0x00;
+    this->_mReconnectAttempt = 0x00;
+    this->_mReconnectTime = 0x00;
+    this->_mSubscriptionCount = 0x00;
+    this->_mPendingCount = 0x00;
+    this->_mReasonCode = REASON_SUCCESS;
+    this->_mSendQuota = this->_mMaxInflight;
+    this->_mTopicAliasMaximum = 0x00;
+    this->_mAliasCount = 0x00;
+    this->_mMaxPacketSize = 0xFFFFFFFF;
+    this->_mConnections = 0x00;
+    this->_mCurrentMessageID = 0x01;
+    this->_mStatus = DISCONNECTED;
+    this->_mConnectError = NO_ERROR;
+    this->_mStreamRemaining = 0x00;
+    this->_mStreamMessage = NULL;
+    this->_mPingQueued = false;
+    this->_mWaitForHostPing = false;
+    this->_mPipelined = false;
+    this->_mPingTimeout = false;
+    this->_mCorked = false;
+    this->_mCorkLength = 0x00;
+    this->_mRxState = RX_FIXED_HEADER;
+    this->_mRxTail = 0x00;
+    this->_mRxCount = 0x00;
+    this->_mPingStart = 0x00;
+    this->_mLastTransmit = 0x00;
+
+    for(uint8_t i = 0x00; i < this->_mMaxInflight; i++)
+    {
+        this->_mInflight[i].State = INFLIGHT_FREE;
+    }
+
+    this->ResetStatistics();
+
+    this->_mQueueHead = 0x00;
+    this->_mQueueTail = 0x00;
+    for(uint32_t i = 0x00; i < this->_mQueueSize; i++)
+    {
+        this->_mQueue[i].Sequence = i;
+    }
 
-    this->_mPingTimer = new Timer(this->_mKeepAlive * 1000UL, &MQTT::_sendPing, *this);
+    // The timer runs with half of the keep-alive time, so a ping is always transmitted in time
+    this->_mPingTimer = new Timer(this->_mKeepAlive * 500UL, &MQTT::_sendPing, *this);
     this->_mPingTimer->stop();
 }
 
-void MQTT::_copyString(const char* String, uint16_t* Offset)
+void MQTT::_finishConnect(MQTT::Error Error)
 {
-    uint16_t StringLength = 0x00;
-    uint16_t Temp_Offset = *Offset;
+    this->_mConnectError = Error;
 
-    // Skip the two size bytes
-    Temp_Offset += 0x02;
-
-    // Copy each character from the string into the transmit buffer
-    while(*String && (Temp_Offset < MQTT_BUFFER_SIZE))
+    if(Error == NO_ERROR)
     {
-        _mBuffer[Temp_Offset++] = *String++;
-        StringLength++;
+        this->_mWaitForHostPing = false;
+        this->_mReconnectAttempt = 0x00;
+        this->_mConnections++;
+        this->_setStatus(CONNECTED, NO_ERROR);
+
+        // The DISCONNECT of a pipelined connection was transmitted before the CONNACK, so the connection
+        // must not be used anymore. Subscriptions and unacknowledged messages wait for the next connection.
+        if(!this->_mPipelined)
+        {
+            this->_mPingTimer->start();
+
+            // Restore all subscriptions with a single request when the broker has no session for this client
+            if(!this->_mSessionPresent && this->_mSubscriptionCount)
+            {
+                this->_sendSubscribe(this->_mSubscriptions, this->_mSubscriptionCount, NULL);
+            }
+
+            // Transmit all messages from the previous session again
+            this->_retransmit(true);
+        }
     }
+    else
+    {
+        this->_mClient.stop();
+        this->_setStatus(DISCONNECTED, Error);
 
-    // Set the length of the string
-    _mBuffer[Temp_Offset - StringLength - 0x01] = (StringLength & 0xFF);
-    _mBuffer[Temp_Offset - StringLength - 0x02] = (StringLength >> 0x08);
+        // Don´t retry when the broker has refused the client
+        if((Error != HOST_UNREACHABLE) || (this->_mConnectionState == SERVER_UNAVAILALE))
+        {
+            this->_scheduleReconnect();
+        }
+    }
 
-    // Write the new offset
-    *Offset = Temp_Offset;
+    if(this->_mConnectCallback != NULL)
+    {
+        this->_mConnectCallback(Error, this->_mConnectionState);
+    }
 }
 
 void MQTT::_increaseID(void)
 {
-    if(this->_mCurrentMessageID == 0x00)
+    // The message ID 0 is not allowed
+    if(++this->_mCurrentMessageID == 0x00)
     {
         this->_mCurrentMessageID = 0x01;
     }
-    else
+}
+
+void MQTT::_completeStream(void)
+{
+    MQTT::Inflight* Message = this->_mStreamMessage;
+
+    if(Message == NULL)
     {
-       this->_mCurrentMessageID++;
+        return;
     }
+
+    // The QoS is stored in bit 1 and bit 2 of the fixed header
+    Message->State = (((Message->Packet[0] >> 0x01) & 0x03) == MQTT::QOS_1) ? INFLIGHT_PUBACK : INFLIGHT_PUBREC;
+    Message->Timestamp = millis();
+    Message->Sent = Message->Timestamp;
+    Message->Retries = 0x00;
+
+    this->_mStreamMessage = NULL;
 }
 
-void MQTT::_sendPing(void)
+MQTT::Inflight* MQTT::_allocateInflight(void)
 {
+    uint8_t Used = 0x00;
+    MQTT::Inflight* Free = NULL;
+
+    for(uint8_t i = 0x00; i < this->_mMaxInflight; i++)
+    {
+        if(this->_mInflight[i].State != INFLIGHT_FREE)
+        {
+            Used++;
+        }
+        else if(Free == NULL)
+        {
+            Free = &this->_mInflight[i];
+        }
+    }
+
+    // MQTT 5 brokers can limit the number of unacknowledged messages with the receive maximum
+    if(Used >= this->_mSendQuota)
+    {
+        return NULL;
+    }
+
+    return Free;
+}
+
+MQTT::Inflight* MQTT::_findInflight(uint16_t ID, MQTT::InflightState State)
+{
+    for(uint8_t i = 0x00; i < this->_mMaxInflight; i++)
+    {
+        if((this->_mInflight[i].State == State) && (this->_mInflight[i].ID == ID))
+        {
+            return &this->_mInflight[i];
+        }
+    }
+
+    return NULL;
+}
+
+MQTT::Error MQTT::_retransmit(bool Force)
+{
+    for(uint8_t i = 0x00; i < this->_mMaxInflight; i++)
+    {
+        MQTT::Inflight* Message = &this->_mInflight[i];
+
+        if((Message->State == INFLIGHT_FREE) || ((!Force) && ((millis() - Message->Timestamp) < MQTT_RETRY_TIMEOUT)))
+        {
+            continue;
+        }
+
+        Message->Timestamp = millis();
+        Message->Retries++;
+        this->_mStatistics.Retransmissions++;
+
+        // The broker has received the message already. Only the release is missing
+        if(Message->State == INFLIGHT_PUBCOMP)
+        {
+            if(this->_publishRelease(Message->ID))
+            {
+                return TRANSMISSION_ERROR;
+            }
+
+            continue;
+        }
+
+        // Set the DUP flag and transmit the message again
+        Message->Packet[0] |= (0x01 << 0x03);
+        this->_countSent(Message->Packet[0]);
+        if(this->_transmit(Message->Packet, Message->Length))
+        {
+            return TRANSMISSION_ERROR;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+void MQTT::_countSent(uint8_t Header)
+{
+    this->_mStatistics.PacketsSent[Header >> 0x04]++;
+}
+
+void MQTT::_addSample(MQTT::Histogram* Histogram, uint32_t Time)
+{
+    uint8_t Bucket = 0x00;
+
+    Histogram->Count++;
+    Histogram->Sum += Time;
+
+    if(Time > Histogram->Max)
+    {
+        Histogram->Max = Time;
+    }
+
+    // Search the first bucket with a limit above the sample
+    while((Bucket < (MQTT_HISTOGRAM_BUCKETS - 0x01)) && (Time >= ((uint32_t)MQTT_HISTOGRAM_RESOLUTION << Bucket)))
+    {
+        Bucket++;
+    }
+
+    Histogram->Buckets[Bucket]++;
+}
+
+void MQTT::_setStatus(MQTT::Status Status, MQTT::Error Reason)
+{
+    if(this->_mStatus == Status)
+    {
+        return;
+    }
+
+    this->_mStatus = Status;
+
+    if(this->_mStatusCallback != NULL)
+    {
+        this->_mStatusCallback(Status, Reason);
+    }
+}
+
+void MQTT::_linkLost(MQTT::Error Reason)
+{
+    this->_mClient.stop();
+    this->_mPingTimer->stop();
+    this->_mPingQueued = false;
+    this->_mWaitForHostPing = false;
+
+    this->_setStatus(DISCONNECTED, Reason);
+    this->_scheduleReconnect();
+}
+
+void MQTT::_scheduleReconnect(void)
+{
+    if(this->_mReconnectBudget == 0x00)
+    {
+        this->_mReconnectPending = false;
+
+        return;
+    }
+
+    this->_mReconnectBudget--;
+    this->_mReconnectTime = millis() + MQTT::backoff(this->_mReconnectAttempt++);
+    this->_mReconnectPending = true;
+}
+
+MQTT::Error MQTT::_sendSubscribe(const MQTT::Subscription* Subscriptions, uint8_t Count, uint16_t* ID)
+{
+    MQTTCodec::Error Error;
+    uint16_t Start;
+    uint16_t Length;
+
     if(this->isConnected())
     {
-        // Are we already waiting for a ping from the host?
-        if(this->_mWaitForHostPing)
+        if(this->_mPendingCount == MQTT_MAX_PENDING_REQUESTS)
+        {
+            return INFLIGHT_FULL;
+        }
+
+        Error = MQTTCodec::EncodeSubscribe(this->_mBuffer, this->_mBufferSize, this->_mVersion, this->_mCurrentMessageID, Subscriptions, Count, &Start, &Length);
+        if(Error)
+        {
+            return MQTT::_codecError(Error);
+        }
+
+        if(ID != NULL)
+        {
+            *ID = this->_mCurrentMessageID;
+        }
+
+        this->_mPendingRequests[this->_mPendingCount++] = {this->_mCurrentMessageID, SUBACK, Count};
+        this->_increaseID();
+
+        // Transmit the buffer
+        return this->_writePacket(Start, Length);
+    }
+
+    return NOT_CONNECTED;
+}
+
+bool MQTT::_completeRequest(MQTT::ControlPacket Ack, uint16_t ID, uint8_t Count)
+{
+    for(uint8_t i = 0x00; i < this->_mPendingCount; i++)
+    {
+        MQTT::PendingRequest* Request = &this->_mPendingRequests[i];
+
+        if((Request->ID == ID) && (Request->Ack == Ack))
+        {
+            // The broker has to answer each topic filter of the request
+            if(Request->Count != Count)
+            {
+                return false;
+            }
+
+            *Request = this->_mPendingRequests[--this->_mPendingCount];
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void MQTT::_sendPing(void)
+{
+    // NOTE: This function is called from the timer thread. The socket is owned by the thread that calls #Poll,
+    //       so the ping is transmitted with the message queue.
+    uint32_t Now = millis();
+    uint32_t Interval = this->_mKeepAlive * 500UL;
+
+    if(this->_mStatus != CONNECTED)
+    {
+        return;
+    }
+
+    // The ping request wasn´t transmitted yet, because #Poll isn´t called at the moment
+    if(this->_mPingQueued)
+    {
+        return;
+    }
+
+    // The broker has to answer a ping request within half of the keep-alive time. Otherwise the peer is dead
+    if(this->_mWaitForHostPing)
+    {
+        if((Now - this->_mPingStart) >= Interval)
         {
-            this->_mClient.stop();
+            this->_mPingTimeout = true;
         }
 
-        // Send new ping
-        this->_mBuffer[0] = (PINGREQ << 0x04);
-        this->_mBuffer[1] = 0x00;
-        this->_mClient.write(this->_mBuffer, 0x02);
-        this->_mWaitForHostPing = true;
+        return;
+    }
+
+    // Other packets were transmitted recently, so the broker knows that the client is alive
+    if((Now - this->_mLastTransmit) < Interval)
+    {
+        return;
+    }
+
+    // Send new ping. The timeout starts when #Poll transmits the request
+    const uint8_t Ping[] = {(PINGREQ << 0x04), 0x00};
+    this->_mPingQueued = true;
+    if(this->_enqueue(Ping, sizeof(Ping)) != NO_ERROR)
+    {
+        this->_mPingQueued = false;
     }
-}
\ No newline at end of file
+}
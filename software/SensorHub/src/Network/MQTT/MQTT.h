@@ -22,17 +22,37 @@
   Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
  */
 
+#pragma once
+
 /** @file MQTT/MQTT.h
- *  @brief MQTT 3.1.1 implementation for the Particle IoT Argon.
+ *  @brief MQTT 3.1.1 and MQTT 5 implementation for the Particle IoT Argon.
  *		   Please read 
  *			- http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Table_2.6_-
+ *			- https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html
  *		   when you need more information.
  *
+ *         MQTT 5 support is limited to the properties which are useful for small devices: Receive Maximum,
+ *         Maximum Packet Size, Session Expiry Interval, topic aliases for prepared publishes and the reason codes.
+ *         All other properties from the broker are skipped.
+ *
+ *         The client is owned by a single network task, which calls #Poll and all other functions.
+ *         Other threads (i. e. the ping timer or a sampling thread) can only use #PublishAsync, which
+ *         pushes the encoded message into a lock-free queue. The queue is transmitted with the next #Poll call.
+ *
+ *         The buffers are not part of this class. Use the #MQTTClient template from MQTT/MQTTClient.h
+ *         to create a client with the buffer sizes and the protocol version for your application.
+ *
+ *         The control packets are encoded and decoded with #MQTTCodec from MQTT/MQTTCodec.h.
+ *
  *  @author Daniel Kampert
- *  @bug - Improve code to support larger messages than 256 bytes (needs a lot of rework :/)
  */
 
+#include <atomic>
+
 #include "application.h"
+#include "MQTTCodec.h"
+
+template<uint16_t TxSize, uint16_t RxSize, uint8_t MaxInflight, uint16_t InflightSize, uint8_t QueueSize, uint16_t QueueEntrySize, uint16_t CorkSize> class MQTTBuffers;
 
 class MQTT
 {
@@ -45,14 +65,76 @@ class MQTT
          */
         #define MQTT_DEFAULT_PORT                       1883
 
-        /** @brief MQTT version for the client.
+        /** @brief Default MQTT version for the client.
          */
         #define MQTT_VERSION                            MQTT_VERSION_3_1_1
 
-        /** @brief Size of the transceive buffer.
+        /** @brief Default size of the transmit buffer (fixed header, variable header and the topic).
          */
         #define MQTT_BUFFER_SIZE                        256
 
+        /** @brief Default size of the receive ring buffer.
+         *         NOTE: Must be a power of two!
+         */
+        #define MQTT_RX_BUFFER_SIZE                     256
+
+        /** @brief Maximum number of bytes that are passed to the TCP client with a single write call.
+         */
+        #define MQTT_CHUNK_SIZE                         128
+
+        /** @brief Default size of the staging buffer for corked transmissions.
+         */
+        #define MQTT_CORK_BUFFER_SIZE                   512
+
+        /** @brief Size of the packet buffer of a prepared publish (fixed header, topic and message ID).
+         */
+        #define MQTT_PREPARED_BUFFER_SIZE               64
+
+        /** @brief Number of buckets of a latency histogram.
+         */
+        #define MQTT_HISTOGRAM_BUCKETS                  8
+
+        /** @brief Upper limit of the first histogram bucket in ms. The limit doubles with each following bucket.
+         */
+        #define MQTT_HISTOGRAM_RESOLUTION               16
+
+        /** @brief Default number of entries in the queue for messages from other threads.
+         *         NOTE: Must be a power of two!
+         */
+        #define MQTT_QUEUE_SIZE                         8
+
+        /** @brief Default size of a single queue entry (complete message including the fixed header).
+         */
+        #define MQTT_QUEUE_ENTRY_SIZE                   128
+
+        /** @brief Default maximum number of unacknowledged QoS 1 and QoS 2 messages.
+         */
+        #define MQTT_MAX_INFLIGHT                       4
+
+        /** @brief Default size of the buffer for each unacknowledged message (including the fixed header).
+         */
+        #define MQTT_INFLIGHT_BUFFER_SIZE               256
+
+        /** @brief Time in milliseconds before an unacknowledged message is transmitted again (MQTT 3.1.1 only).
+         */
+        #define MQTT_RETRY_TIMEOUT                      5000
+
+        /** @brief Delay in milliseconds before the first reconnect attempt. The delay doubles with each failed attempt.
+         */
+        #define MQTT_RECONNECT_MIN_DELAY                500
+
+        /** @brief Maximum delay in milliseconds between two reconnect attempts.
+         */
+        #define MQTT_RECONNECT_MAX_DELAY                16000
+
+        /** @brief Maximum number of subscriptions which are restored after a reconnect.
+         */
+        #define MQTT_MAX_SUBSCRIPTIONS                  4
+
+        /** @brief Maximum number of SUBSCRIBE and UNSUBSCRIBE requests which wait for the answer of the broker.
+         */
+        #define MQTT_MAX_PENDING_REQUESTS               4
+
         /** @brief MQTT error codes.
          */
         typedef enum
@@ -66,6 +148,10 @@ class MQTT
             TIMEOUT = 0x06,							            /**< Timeout while connecting with server. */
             BUFFER_OVERFLOW = 0x07,							    /**< Transmit / Receive buffer overflow. */
             HOST_UNREACHABLE = 0x08,						    /**< Host unreachable. Call #connectionState to get a more detailed message. */
+            INFLIGHT_FULL = 0x09,						        /**< Too many unacknowledged QoS 1 and QoS 2 messages or SUBSCRIBE and UNSUBSCRIBE requests. Call #Poll and try again later. */
+            QUEUE_FULL = 0x0A,						            /**< The message queue is full. The network task has to call #Poll first. */
+            CONNECTION_LOST = 0x0B,						        /**< The connection was closed by the broker or the network. */
+            PACKET_TOO_LARGE = 0x0C,						    /**< The packet exceeds the maximum packet size of the broker (MQTT 5 only). */
         } Error;
 
         /** @brief MQTT quality of service classes.
@@ -89,6 +175,41 @@ class MQTT
             NOT_AUTHORIZED = 0x05,							    /**< The Client is not authorized to connect. */
         } ConnectionState;
 
+        /** @brief MQTT 5 reason codes (subset). Codes below #REASON_UNSPECIFIED_ERROR indicate success.
+         */
+        typedef enum
+        {
+            REASON_SUCCESS = 0x00,							    /**< Success. */
+            REASON_NO_MATCHING_SUBSCRIBERS = 0x10,				/**< The message was accepted, but there are no subscribers. */
+            REASON_UNSPECIFIED_ERROR = 0x80,					/**< Unspecified error. */
+            REASON_MALFORMED_PACKET = 0x81,					    /**< The packet could not be parsed. */
+            REASON_PROTOCOL_ERROR = 0x82,					    /**< The packet violates the protocol. */
+            REASON_IMPLEMENTATION_SPECIFIC = 0x83,				/**< The packet is valid, but not accepted by the broker. */
+            REASON_UNSUPPORTED_PROTOCOL = 0x84,					/**< The broker doesn´t support the requested protocol version. */
+            REASON_CLIENT_ID_NOT_VALID = 0x85,					/**< The client identifier is not allowed by the broker. */
+            REASON_BAD_USER_PASSWORD = 0x86,					/**< Bad user name or password. */
+            REASON_NOT_AUTHORIZED = 0x87,					    /**< The client is not authorized. */
+            REASON_SERVER_UNAVAILABLE = 0x88,					/**< The broker is not available. */
+            REASON_SERVER_BUSY = 0x89,					        /**< The broker is busy. */
+            REASON_BANNED = 0x8A,					            /**< The client is banned. */
+            REASON_TOPIC_NAME_INVALID = 0x90,					/**< The topic name is not accepted. */
+            REASON_RECEIVE_MAXIMUM_EXCEEDED = 0x93,				/**< The client has exceeded the receive maximum of the broker. */
+            REASON_TOPIC_ALIAS_INVALID = 0x94,					/**< The topic alias is not accepted. */
+            REASON_PACKET_TOO_LARGE = 0x95,					    /**< The packet exceeds the maximum packet size of the broker. */
+            REASON_QUOTA_EXCEEDED = 0x97,					    /**< An implementation or administrative limit has been exceeded. */
+            REASON_PAYLOAD_FORMAT_INVALID = 0x99,				/**< The payload doesn´t match the payload format indicator. */
+            REASON_CONNECTION_RATE_EXCEEDED = 0x9F,				/**< The client connects too often. */
+        } ReasonCode;
+
+        /** @brief MQTT client status.
+         */
+        typedef enum
+        {
+            DISCONNECTED = 0x00,							    /**< No connection with the broker. */
+            CONNECTING = 0x01,							        /**< Connection request was transmitted. Waiting for the answer from the broker. */
+            CONNECTED = 0x02,							        /**< Connection accepted by the broker. */
+        } Status;
+
         /** @brief MQTT will settings object.
          */
         typedef struct
@@ -108,54 +229,163 @@ class MQTT
             const uint16_t PasswordLength;						/**< Length of the user password. */
         } User;
 
-        /** @brief                  Publish received callback prototype.
-         *  @param TopicLength      Length of the topic string
-         *  @param Topic            Pointer to the topic string
-         *  @param PayloadLength    Length of the payload
-         *  @param Payload          Pointer to the payload
-         *  @param QoS              Quality of service of the received message
-         *  @param DUP              Received DUP flag
+        /** @brief MQTT payload segment object for scatter / gather transmissions.
+         */
+        typedef struct
+        {
+            const uint8_t* Data;							    /**< Pointer to the segment data. */
+            uint16_t Length;							        /**< Length of the segment. */
+        } Segment;
+
+        /** @brief MQTT subscription object (topic filter and the maximum quality of service) for #Subscribe.
+         */
+        typedef MQTTCodec::TopicFilter Subscription;
+
+        /** @brief Prepared publish object. Holds the pre-encoded topic and the flags of the fixed header for
+         *         messages which are published repeatedly with the same topic. Use #PreparePublish to create the object.
+         */
+        typedef struct
+        {
+            uint8_t Packet[MQTT_PREPARED_BUFFER_SIZE];			/**< Space for the fixed header, the encoded topic and the message ID. */
+            uint16_t Length;							        /**< Length of the encoded topic and the message ID. */
+            uint8_t Flags;							            /**< Flags for the fixed header. */
+            MQTT::QoS QoS;							            /**< Quality of service for the messages. */
+            uint16_t Alias;							            /**< Topic alias (MQTT 5 only). 0 when the topic doesn´t use an alias. */
+            uint32_t Connection;							    /**< Connection in which the broker has learned the topic alias. */
+        } PreparedPublish;
+
+        /** @brief MQTT QoS 0 message object for #ConnectAndPublish.
+         */
+        typedef struct
+        {
+            const char* Topic;							        /**< MQTT topic. */
+            const uint8_t* Payload;							    /**< Message payload. */
+            uint16_t Length;							        /**< Payload length. */
+            bool Retain;							            /**< Retain flag for the broker. */
+            MQTT::PreparedPublish* Prepared;					/**< Optional prepared publish object. #Topic and #Retain are ignored when set. */
+        } PublishMessage;
+
+        /** @brief View into the receive buffer. The data can wrap around at the end of the
+         *         receive buffer, so it is split into a first and an optional second part.
+         */
+        typedef struct
+        {
+            const char* First;							        /**< Pointer to the first part of the data. */
+            uint16_t FirstLength;							    /**< Length of the first part. */
+            const char* Second;							        /**< Pointer to the wrapped around part of the data. NULL if the data doesn´t wrap around. */
+            uint16_t SecondLength;							    /**< Length of the wrapped around part. */
+        } View;
+
+        /** @brief Latency histogram with fixed buckets.
+         */
+        typedef struct
+        {
+            uint32_t Count;							            /**< Number of samples. */
+            uint32_t Sum;							            /**< Sum of all samples in ms. */
+            uint32_t Max;							            /**< Largest sample in ms. */
+            uint16_t Buckets[MQTT_HISTOGRAM_BUCKETS];			/**< Bucket n counts the samples below #MQTT_HISTOGRAM_RESOLUTION * 2^n ms. The last bucket counts all larger samples. */
+        } Histogram;
+
+        /** @brief Statistics of the client. Use #statistics to get a snapshot.
+         */
+        typedef struct
+        {
+            uint32_t BytesSent;							        /**< Bytes passed to the TCP client. */
+            uint32_t BytesReceived;							    /**< Bytes read from the TCP client. */
+            uint16_t PacketsSent[16];							/**< Transmitted control packets, indexed by the packet type. */
+            uint16_t PacketsReceived[16];						/**< Received control packets, indexed by the packet type. */
+            MQTT::Histogram Connect;							/**< Time between CONNECT and CONNACK. */
+            MQTT::Histogram Publish;							/**< Time between PUBLISH and PUBACK (QoS 1) or PUBCOMP (QoS 2). Retransmitted messages are ignored. */
+            MQTT::Histogram Ping;							    /**< Time between PINGREQ and PINGRESP. */
+            uint16_t ConnectTimeouts;							/**< Connection requests without answer from the broker. */
+            uint16_t PingTimeouts;							    /**< Pings without answer from the broker. */
+            uint16_t Retransmissions;							/**< Retransmitted QoS 1 and QoS 2 packets. */
+            uint16_t RxOverflows;							    /**< Received messages which doesn´t fit into the receive buffer. */
+            uint16_t QueueOverflows;							/**< Messages rejected because of a full message queue. */
+            uint16_t InflightOverflows;							/**< Messages rejected because of a full in-flight window. */
+        } Statistics;
+
+        /** @brief          Publish received callback prototype.
+         *                  NOTE: The views are only valid during the callback!
+         *  @param Topic    Pointer to view of the topic string
+         *  @param Payload  Pointer to view of the payload
+         *  @param ID       Message ID
+         *  @param QoS      Quality of service of the received message
+         *  @param DUP      Received DUP flag
+         */
+        typedef void(*Publish_Callback)(const MQTT::View* Topic, const MQTT::View* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP);
+
+        /** @brief          Connect finished callback prototype.
+         *  @param Error    Result of the connection request
+         *  @param State    Return code from the broker
+         */
+        typedef void(*Connect_Callback)(MQTT::Error Error, MQTT::ConnectionState State);
+
+        /** @brief          Status changed callback prototype.
+         *  @param Status   New status of the client
+         *  @param Reason   Reason for the status change.
+         *                  NOTE: #TIMEOUT when the broker doesn´t answer the ping requests and
+         *                        #CONNECTION_LOST when the connection was closed by the broker or the network.
          */
-        typedef void(*Publish_Callback)(uint16_t TopicLength, char* Topic, uint16_t PayloadLength, char* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP);
+        typedef void(*Status_Callback)(MQTT::Status Status, MQTT::Error Reason);
+
+        /** @brief              Subscribe finished callback prototype. Called for each SUBACK and UNSUBACK from the broker.
+         *                      Acknowledges which doesn´t match a pending request of the client are ignored.
+         *                      NOTE: The return codes are only valid during the callback!
+         *  @param ID           Message ID of the SUBSCRIBE or UNSUBSCRIBE request
+         *  @param ReturnCodes  Return code for each topic filter of the request in the order of the request.
+         *                      Values below 0x80 are accepted subscriptions with the granted QoS
+         *  @param Count        Number of return codes. 0 for an UNSUBACK from a MQTT 3.1.1 broker
+         */
+        typedef void(*Subscribe_Callback)(uint16_t ID, const uint8_t* ReturnCodes, uint8_t Count);
 
         /** @brief	Can be used to check the connection state of the TCP client.
          *  @return	#true when connected
          */
         bool isConnected(void);
 
+        /** @brief	Check if a reconnect attempt is scheduled.
+         *  @return	#true when the client will reconnect with one of the next #Poll calls
+         */
+        bool isReconnecting(void) const;
+
+        /** @brief	        Get the delay before a reconnect attempt. The delay grows exponentially up to #MQTT_RECONNECT_MAX_DELAY
+         *                  and the second half of the delay is randomized to spread the reconnects of multiple devices.
+         *  @param Attempt  Number of the failed attempts
+         *  @return	        Delay in milliseconds
+         */
+        static uint32_t backoff(uint8_t Attempt);
+
         /** @brief	Can be used after a #Connect call to check the return code of the broker.
          *  @return	Return code from the broker
          */
         MQTT::ConnectionState connectionState(void) const;
 
-        /** @brief Constructor.
+        /** @brief	Get the last reason code from the broker (CONNACK, PUBACK, PUBREC, PUBCOMP or DISCONNECT).
+         *          NOTE: Only MQTT 5 brokers report reason codes. MQTT 3.1.x always returns #REASON_SUCCESS!
+         *  @return	Reason code from the broker
          */
-        MQTT(void);
+        MQTT::ReasonCode reasonCode(void) const;
 
-        /** @brief      Constructor.
-         *  @param IP   IP address of the MQTT broker
+        /** @brief	Get the status of the MQTT client. Use this function to check the progress
+         *          of a connection request started with #BeginConnect.
+         *  @return	Client status
          */
-        MQTT(IPAddress IP);
-        /** @brief      Constructor.
-         *  @param IP   IP address of the MQTT broker
-         *  @param Port	Port used by the MQTT client
+        MQTT::Status status(void);
+
+        /** @brief	Get the number of unacknowledged QoS 1 and QoS 2 messages.
+         *  @return	Number of messages in the in-flight window
          */
-        MQTT(IPAddress IP, uint16_t Port);
+        uint8_t inflight(void) const;
 
-        /** @brief              Constructor.
-         *  @param IP           IP address of the MQTT broker
-         *  @param Port         Port used by the MQTT client
-         *  @param KeepAlive	Keep-alive time used by the MQTT client
+        /** @brief	            Get a snapshot of the statistics of the client.
+         *  @param Statistics   Pointer to statistics object
          */
-        MQTT(IPAddress IP, uint16_t Port, uint16_t KeepAlive);
+        void statistics(MQTT::Statistics* Statistics) const;
 
-        /** @brief              Constructor.
-         *  @param IP           IP address of the MQTT broker
-         *  @param Port         Port used by the MQTT client
-         *  @param KeepAlive    Keep-alive time used by the MQTT client
-         *  @param Callback     Publish received callback
+        /** @brief Reset all statistics of the client.
          */
-        MQTT(IPAddress IP, uint16_t Port, uint16_t KeepAlive, Publish_Callback Callback);
+        void ResetStatistics(void);
 
         /** @brief Deconstructor. Stops the timer and close the network connection.
          */
@@ -191,10 +421,46 @@ class MQTT
          */
         MQTT::Error Connect(const char* ClientID, bool CleanSession, MQTT::Will* Will, MQTT::User* User);
 
+        /** @brief              Start a connection request without waiting for the answer from the broker.
+         *                      The answer is processed with the next #Poll calls. Use #status or the
+         *                      connect callback to check the result of the request.
+         *  @param ClientID     The Client Identifier identifies the Client to the Server.
+         *  @param CleanSession The Client and Server can store Session state to enable reliable messaging to continue across a sequence of Network Connections.
+         *  @param Will         Pointer to configuration object for the Will message
+         *  @param User         Pointer to user settings object.
+         *  @return             Error code
+         */
+        MQTT::Error BeginConnect(const char* ClientID, bool CleanSession, MQTT::Will* Will, MQTT::User* User);
+
+        /** @brief              Open a connection with the MQTT broker, publish a list of QoS 0 messages and close the connection.
+         *                      The connection request, the messages and the disconnect are transmitted in a single flight
+         *                      without waiting for the CONNACK. The answer from the broker is checked afterwards.
+         *  @param ClientID     The Client Identifier identifies the Client to the Server.
+         *  @param CleanSession The Client and Server can store Session state to enable reliable messaging to continue across a sequence of Network Connections.
+         *  @param Messages     Array with messages
+         *  @param Count        Number of messages
+         *  @return             Error code
+         *                      NOTE: The messages are discarded by the broker when the connection is refused!
+         *                      NOTE: Subscriptions and unacknowledged messages aren´t restored with this connection!
+         */
+        MQTT::Error ConnectAndPublish(const char* ClientID, bool CleanSession, const MQTT::PublishMessage* Messages, uint8_t Count);
+
         /** @brief Close the connection with the MQTT broker.
+         *         NOTE: Messages queued with #Cork are transmitted before the connection is closed.
          */
         void Disonnect(void);
 
+        /** @brief Queue all following control packets in a staging buffer instead of transmitting them directly.
+         *         The queued packets are transmitted with a single write call when #Uncork is called or
+         *         when the staging buffer is full.
+         */
+        void Cork(void);
+
+        /** @brief  Transmit all queued control packets and disable the queuing.
+         *  @return Error code
+         */
+        MQTT::Error Uncork(void);
+
         /** @brief      Set the IP address for the communication with the broker.
          *              NOTE: You have to reopen the connection to use the new settings!
          *  @param IP   IP address of the broker
@@ -219,6 +485,31 @@ class MQTT
          */
         void SetCallback(Publish_Callback Callback);
 
+        /** @brief              Set the callback for finished connection requests.
+         *  @param Callback     Connect callback
+         */
+        void SetConnectCallback(Connect_Callback Callback);
+
+        /** @brief              Enable the automatic reconnect. A lost or failed connection is opened again with the parameters
+         *                      of the last #BeginConnect call after a jittered exponential backoff. The in-flight messages are
+         *                      transmitted again and the subscriptions are restored when the broker doesn´t resume the session.
+         *                      NOTE: The reconnect attempts are done by #Poll!
+         *  @param Budget       Maximum number of reconnect attempts. Call this function again to reset the budget. 0 disables the reconnect
+         */
+        void EnableReconnect(uint8_t Budget);
+
+        /** @brief              Set the callback for status changes of the client (i. e. a lost connection).
+         *                      NOTE: The callback is called from #Poll!
+         *  @param Callback     Status callback
+         */
+        void SetStatusCallback(Status_Callback Callback);
+
+        /** @brief              Set the callback for the answers to #Subscribe and #Unsubscribe requests.
+         *                      NOTE: The callback is called from #Poll. The SUBSCRIBE which restores the subscriptions after a reconnect is reported too!
+         *  @param Callback     Subscribe callback
+         */
+        void SetSubscribeCallback(Subscribe_Callback Callback);
+
         /** @brief  Poll the MQTT interface and process incomming messages.
          *  @return Error code
          */
@@ -248,6 +539,9 @@ class MQTT
         MQTT::Error Publish(const char* Topic, const uint8_t* Payload, uint16_t Length);
 
         /** @brief          Publish a message with a given topic.
+         *                  NOTE: QoS 1 and QoS 2 messages are stored in the in-flight window until they are acknowledged
+         *                  by the broker. They are transmitted again with the DUP flag after a reconnect and, with MQTT 3.1.1,
+         *                  after #MQTT_RETRY_TIMEOUT.
          *  @param Topic    MQTT topic
          *  @param Payload  Message payload
          *  @param Length   Payload length
@@ -283,30 +577,141 @@ class MQTT
          */
         MQTT::Error Publish(const char* Topic, const uint8_t* Payload, uint16_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP);
 
+        /** @brief          Publish a message with a given topic. The payload is given as a list of segments
+         *                  which are passed directly to the TCP client without copying them into the transmit buffer.
+         *  @param Topic    MQTT topic
+         *  @param Segments Array with payload segments
+         *  @param Count    Number of payload segments
+         *  @return         Error code
+         */
+        MQTT::Error Publish(const char* Topic, const MQTT::Segment* Segments, uint8_t Count);
+
+        /** @brief          Publish a message with a given topic. The payload is given as a list of segments
+         *                  which are passed directly to the TCP client without copying them into the transmit buffer.
+         *  @param Topic    MQTT topic
+         *  @param Segments Array with payload segments
+         *  @param Count    Number of payload segments
+         *  @param ID       Pointer to message ID.
+         *                  NOTE: Is used only with QoS 1 and QoS 2!
+         *  @param QoS      Quality of service for the message
+         *  @param Retain   Retain flag for the broker
+         *  @param DUP      DUP flag for the broker
+         *  @return         Error code
+         */
+        MQTT::Error Publish(const char* Topic, const MQTT::Segment* Segments, uint8_t Count, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP);
+
+        /** @brief          Encode the topic and the flags for repeated publishes with the same topic.
+         *                  The object can be used with all connections of this client.
+         *                  With MQTT 5 each object gets a topic alias. The first message of a connection transmits the topic
+         *                  and the alias, all following QoS 0 messages only transmit the two byte alias.
+         *                  NOTE: The alias is only used when the broker supports enough topic aliases!
+         *  @param Prepared Pointer to prepared publish object
+         *  @param Topic    MQTT topic
+         *  @param QoS      Quality of service for the messages
+         *  @param Retain   Retain flag for the broker
+         *  @return         Error code
+         */
+        MQTT::Error PreparePublish(MQTT::PreparedPublish* Prepared, const char* Topic, MQTT::QoS QoS, bool Retain);
+
+        /** @brief          Publish a message with a prepared topic. Only the remaining length and the message ID are encoded.
+         *  @param Prepared Pointer to prepared publish object
+         *  @param Payload  Message payload
+         *  @param Length   Payload length
+         *  @param ID       Pointer to message ID.
+         *                  NOTE: Is used only with QoS 1 and QoS 2!
+         *  @return         Error code
+         */
+        MQTT::Error Publish(MQTT::PreparedPublish* Prepared, const uint8_t* Payload, uint16_t Length, uint16_t* ID);
+
+        /** @brief          Publish a message with a prepared topic. The payload is given as a list of segments.
+         *  @param Prepared Pointer to prepared publish object
+         *  @param Segments Array with payload segments
+         *  @param Count    Number of payload segments
+         *  @param ID       Pointer to message ID.
+         *                  NOTE: Is used only with QoS 1 and QoS 2!
+         *  @return         Error code
+         */
+        MQTT::Error Publish(MQTT::PreparedPublish* Prepared, const MQTT::Segment* Segments, uint8_t Count, uint16_t* ID);
+
+        /** @brief          Start a streaming publish. The fixed header and the topic are transmitted immediately
+         *                  and the payload has to be passed with one or more #PublishWrite calls afterwards.
+         *                  NOTE: Use this function for messages that doesn´t fit into the transmit buffer!
+         *                  NOTE: QoS 1 and QoS 2 messages are copied into the in-flight window for retransmissions,
+         *                  so the complete packet must fit into the in-flight buffer of the client!
+         *  @param Topic    MQTT topic
+         *  @param Length   Total payload length
+         *  @param ID       Pointer to message ID.
+         *                  NOTE: Is used only with QoS 1 and QoS 2!
+         *  @param QoS      Quality of service for the message
+         *  @param Retain   Retain flag for the broker
+         *  @param DUP      DUP flag for the broker
+         *  @return         Error code
+         */
+        MQTT::Error PublishBegin(const char* Topic, uint32_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP);
+
+        /** @brief          Transmit the next part of the payload of a streaming publish.
+         *  @param Payload  Payload fragment
+         *  @param Length   Fragment length
+         *  @return         Error code
+         */
+        MQTT::Error PublishWrite(const uint8_t* Payload, uint16_t Length);
+
+        /** @brief  Finish a streaming publish.
+         *  @return Error code
+         *          NOTE: Returns #INVALID_PARAMETER when less payload bytes were written than announced with #PublishBegin!
+         */
+        MQTT::Error PublishEnd(void);
+
+        /** @brief          Publish a QoS 0 message from any thread. The message is encoded into a lock-free queue
+         *                  and transmitted by the network task with the next #Poll call.
+         *  @param Topic    MQTT topic
+         *  @param Payload  Message payload
+         *  @param Length   Payload length
+         *  @return         Error code
+         *                  NOTE: The complete message must fit into a single queue entry (#MQTT_QUEUE_ENTRY_SIZE bytes by default)!
+         */
+        MQTT::Error PublishAsync(const char* Topic, const uint8_t* Payload, uint16_t Length);
+
         /** @brief          Subscribe a topic.
          *  @param Topic    MQTT topic
          *  @return         Error code
          */
         MQTT::Error Subscribe(const char* Topic);
 
-        /** @brief          Subscribe a topic.
+        /** @brief          Subscribe a topic. The subscription is restored after a reconnect.
+         *                  NOTE: The topic is not copied and must be valid as long as the topic is subscribed!
          *  @param Topic    MQTT topic
          *  @param QoS      Quality of service
          *  @return         Error code
          */
         MQTT::Error Subscribe(const char* Topic, MQTT::QoS QoS);
 
+        /** @brief                  Subscribe multiple topics with a single SUBSCRIBE packet. The subscriptions are restored after a reconnect.
+         *                          The return codes of the broker are reported with the subscribe callback.
+         *                          NOTE: The topics are not copied and must be valid as long as the topics are subscribed!
+         *  @param Subscriptions    Array with subscriptions
+         *  @param Count            Number of subscriptions. The client can send and store up to #MQTT_MAX_SUBSCRIPTIONS subscriptions
+         *  @param ID               Pointer to message ID of the request. Can be NULL
+         *  @return                 Error code
+         */
+        MQTT::Error Subscribe(const MQTT::Subscription* Subscriptions, uint8_t Count, uint16_t* ID);
+
         /** @brief          Unsubscribe a topic.
          *  @param Topic    MQTT topic
          *  @return         Error code
          */
         MQTT::Error Unsubscribe(const char* Topic);
 
-    private:
-        /** @brief Size of the fixed header.
+        /** @brief          Unsubscribe multiple topics with a single UNSUBSCRIBE packet.
+         *                  The reason codes of the broker are reported with the subscribe callback.
+         *  @param Topics   Array with topics
+         *  @param Count    Number of topics. Up to #MQTT_MAX_SUBSCRIPTIONS topics
+         *  @param ID       Pointer to message ID of the request. Can be NULL
+         *  @return         Error code
          */
-        #define MQTT_FIXED_HEADER_SIZE                  0x05
+        MQTT::Error Unsubscribe(const char* const* Topics, uint8_t Count, uint16_t* ID);
 
+    protected:
         /** @brief MQTT control packets.
          */
         typedef enum
@@ -327,41 +732,281 @@ class MQTT
             DISCONNECT = 0x0E,
         } ControlPacket;
 
+        /** @brief States of an in-flight message.
+         */
+        typedef enum
+        {
+            INFLIGHT_FREE = 0x00,
+            INFLIGHT_PUBACK = 0x01,
+            INFLIGHT_PUBREC = 0x02,
+            INFLIGHT_PUBCOMP = 0x03,
+        } InflightState;
+
+        /** @brief Unacknowledged QoS 1 or QoS 2 message.
+         */
+        typedef struct
+        {
+            InflightState State;
+            uint16_t ID;
+            uint16_t Length;
+            uint32_t Timestamp;
+            uint32_t Sent;
+            uint8_t Retries;
+            uint8_t* Packet;
+        } Inflight;
+
+        /** @brief Entry of the message queue for messages from other threads.
+         */
+        typedef struct
+        {
+            std::atomic<uint32_t> Sequence;
+            uint16_t Length;
+            uint8_t* Data;
+        } QueueEntry;
+
+        /** @brief Buffers of the client. The storage is provided by #MQTTClient.
+         */
+        typedef struct
+        {
+            uint8_t* Buffer;							        /**< Pointer to transmit buffer. */
+            uint16_t BufferSize;							    /**< Size of the transmit buffer. */
+            uint8_t* RxBuffer;							        /**< Pointer to receive ring buffer. */
+            uint16_t RxBufferSize;							    /**< Size of the receive ring buffer. Must be a power of two. */
+            Inflight* InflightWindow;							/**< Pointer to in-flight window. */
+            uint8_t MaxInflight;							    /**< Number of entries in the in-flight window. */
+            uint16_t InflightSize;							    /**< Size of the packet buffer of each in-flight entry. */
+            QueueEntry* Queue;							        /**< Pointer to message queue. */
+            uint8_t QueueSize;							        /**< Number of entries in the message queue. Must be a power of two. */
+            uint16_t QueueEntrySize;							/**< Size of the packet buffer of each queue entry. */
+            uint8_t* CorkBuffer;							    /**< Pointer to staging buffer for corked transmissions. */
+            uint16_t CorkBufferSize;							/**< Size of the staging buffer. */
+            uint8_t Version;							        /**< MQTT protocol version. */
+        } Storage;
+
+        /** @brief              Constructor.
+         *  @param Storage      Buffers of the client
+         *  @param IP           IP address of the MQTT broker
+         *  @param Port         Port used by the MQTT client
+         *  @param KeepAlive    Keep-alive time used by the MQTT client
+         *  @param Callback     Publish received callback
+         */
+        MQTT(const MQTT::Storage& Storage, IPAddress IP, uint16_t Port, uint16_t KeepAlive, Publish_Callback Callback);
+
+        template<uint16_t TxSize, uint16_t RxSize, uint8_t MaxInflight, uint16_t InflightSize, uint8_t QueueSize, uint16_t QueueEntrySize, uint16_t CorkSize> friend class MQTTBuffers;
+
+    private:
+        /** @brief States of the receive state machine.
+         */
+        typedef enum
+        {
+            RX_FIXED_HEADER = 0x00,
+            RX_BODY = 0x01,
+            RX_DISCARD = 0x02,
+        } ReceiveState;
+
+        /** @brief SUBSCRIBE or UNSUBSCRIBE request without an answer from the broker.
+         */
+        typedef struct
+        {
+            uint16_t ID;
+            uint8_t Ack;
+            uint8_t Count;
+        } PendingRequest;
+
         Timer* _mPingTimer;
 
         TCPClient _mClient;
         IPAddress _mIP;
         ConnectionState _mConnectionState;
+        std::atomic<Status> _mStatus;
+        Error _mConnectError;
         
-        uint8_t _mBuffer[MQTT_BUFFER_SIZE];
+        uint8_t* _mBuffer;
+        uint16_t _mBufferSize;
+        uint8_t* _mRxBuffer;
+        uint16_t _mRxBufferSize;
+        uint8_t _mVersion;
+        uint8_t* _mCorkBuffer;
+        uint16_t _mCorkBufferSize;
+        uint16_t _mCorkLength;
+
+        Inflight* _mInflight;
+        uint8_t _mMaxInflight;
+        uint16_t _mInflightSize;
+
+        QueueEntry* _mQueue;
+        uint8_t _mQueueSize;
+        uint16_t _mQueueEntrySize;
+        std::atomic<uint32_t> _mQueueHead;
+        uint32_t _mQueueTail;
+
+        ReceiveState _mRxState;
+        uint16_t _mRxTail;
+        uint16_t _mRxCount;
+        uint16_t _mRxHeaderSize;
+        uint32_t _mRxRemaining;
 
         uint16_t _mPort;
         uint16_t _mKeepAlive;
         uint16_t _mCurrentMessageID;
 
-        bool _mWaitForHostPing;
+        uint32_t _mStreamRemaining;
+        Inflight* _mStreamMessage;
+        uint32_t _mConnectStart;
+
+        std::atomic<bool> _mPingQueued;
+        std::atomic<bool> _mWaitForHostPing;
+        std::atomic<bool> _mPingTimeout;
+        bool _mCorked;
 
         Publish_Callback _mCallback;
+        Connect_Callback _mConnectCallback;
+        Status_Callback _mStatusCallback;
+        Subscribe_Callback _mSubscribeCallback;
 
-        /** @brief	Read a single byte from the TCP client.
-         *  @return	Received byte
-         */
-        uint8_t _readByte(void);
+        Statistics _mStatistics;
+
+        const char* _mClientID;
+        bool _mCleanSession;
+        Will* _mWill;
+        User* _mUser;
+        bool _mSessionPresent;
+        bool _mPipelined;
 
-        /** @brief	                Get the answer from the broker.
-         *  @param FixedHeaderSize  Pointer to size of the fixed header
+        bool _mReconnectPending;
+        uint8_t _mReconnectBudget;
+        uint8_t _mReconnectAttempt;
+        uint32_t _mReconnectTime;
+
+        Subscription _mSubscriptions[MQTT_MAX_SUBSCRIPTIONS];
+        uint8_t _mSubscriptionCount;
+        PendingRequest _mPendingRequests[MQTT_MAX_PENDING_REQUESTS];
+        uint8_t _mPendingCount;
+
+        ReasonCode _mReasonCode;
+        uint16_t _mSendQuota;
+        uint16_t _mTopicAliasMaximum;
+        uint16_t _mAliasCount;
+        uint32_t _mMaxPacketSize;
+        uint32_t _mConnections;
+        std::atomic<uint16_t> _mQueueOverflows;
+        std::atomic<uint32_t> _mPingStart;
+        std::atomic<uint32_t> _mLastTransmit;
+
+        /** @brief	                Process the available bytes from the TCP client without blocking.
+         *                          Incomplete messages are stored in the receive buffer and continued with the next call.
+         *                          NOTE: A complete message stays in the receive buffer until #_consume is called!
+         *  @param FixedHeaderSize  Pointer to size of the fixed header.
+         *                          NOTE: Is set to 0 when no complete message is available!
          *  @param Bytes            Pointer to received bytes
          *  @return	                Error code
          */
         MQTT::Error _readMessage(uint16_t* FixedHeaderSize, uint16_t* Bytes);
 
-        /** @brief	                Transmit a message to the broker.
-         *  @param ControlPacket    Type of the transmitted MQTT control packet
-         *  @param Flags            Additional flags for the control packet
-         *  @param Length           Length of the message without the fixed header.
+        /** @brief Read all available bytes from the TCP client into the receive buffer.
+         */
+        void _fillBuffer(void);
+
+        /** @brief          Read a byte from the receive buffer without removing it.
+         *  @param Offset   Offset from the beginning of the current message
+         *  @return         Byte at the given offset
+         */
+        uint8_t _peek(uint16_t Offset) const;
+
+        /** @brief          Create a view into the receive buffer.
+         *  @param Offset   Offset from the beginning of the current message
+         *  @param Length   Length of the view
+         *  @param View     Pointer to view object
+         */
+        void _view(uint16_t Offset, uint16_t Length, MQTT::View* View) const;
+
+        /** @brief          Create a codec reader for the current message in the receive buffer.
+         *  @param Length   Number of bytes of the message
+         *  @return         Reader object
+         */
+        MQTTCodec::Reader _reader(uint16_t Length) const;
+
+        /** @brief          Check the reason code of a MQTT 5 acknowledge.
+         *  @param Ack      Decoded acknowledge
+         *  @return         #true when the broker has reported an error
+         */
+        bool _acknowledgeFailed(const MQTTCodec::Ack& Ack);
+
+        /** @brief          Convert a codec error into a client error.
+         *  @param Error    Codec error
+         *  @return         Error code
+         */
+        static MQTT::Error _codecError(MQTTCodec::Error Error);
+
+        /** @brief          Convert a MQTT 5 CONNACK reason code into a MQTT 3.1.1 return code.
+         *  @param Reason   Reason code from the broker
+         *  @return         Return code
+         */
+        static MQTT::ConnectionState _connectionState(uint8_t Reason);
+
+        /** @brief          Remove bytes from the receive buffer.
+         *  @param Length   Number of bytes
+         */
+        void _consume(uint16_t Length);
+
+        /** @brief	                Process a complete message from the receive buffer.
+         *  @param FixedHeaderSize  Size of the fixed header
+         *  @param Bytes            Number of received bytes
          *  @return	                Error code
          */
-        MQTT::Error _writeMessage(MQTT::ControlPacket ControlPacket, uint8_t Flags, uint16_t Length);
+        MQTT::Error _processMessage(uint16_t FixedHeaderSize, uint16_t Bytes);
+
+        /** @brief          Transmit an encoded packet from the transmit buffer to the broker.
+         *  @param Start    Offset of the packet in the transmit buffer
+         *  @param Length   Length of the packet
+         *  @return         Error code
+         */
+        MQTT::Error _writePacket(uint16_t Start, uint16_t Length);
+
+        /** @brief          Transmit raw data to the broker or queue the data when the client is corked.
+         *  @param Data     Pointer to data
+         *  @param Length   Data length
+         *  @return         Error code
+         */
+        MQTT::Error _transmit(const uint8_t* Data, uint32_t Length);
+
+        /** @brief          Write raw data in chunks of #MQTT_CHUNK_SIZE bytes to the TCP client.
+         *  @param Data     Pointer to data
+         *  @param Length   Data length
+         *  @return         Error code
+         */
+        MQTT::Error _write(const uint8_t* Data, uint32_t Length);
+
+        /** @brief  Transmit the content of the staging buffer with a single write call.
+         *  @return Error code
+         */
+        MQTT::Error _flush(void);
+
+        /** @brief                  Encode the header of a publish message in the transmit buffer.
+         *  @param Topic            MQTT topic
+         *  @param Length           Length of the payload
+         *  @param ID               Pointer to message ID
+         *  @param QoS              Quality of service for the message
+         *  @param Retain           Retain flag for the broker
+         *  @param DUP              DUP flag for the broker
+         *  @param Start            Pointer to offset of the header in the transmit buffer
+         *  @param HeaderLength     Pointer to length of the header
+         *  @return                 Error code
+         */
+        MQTT::Error _preparePublish(const char* Topic, uint32_t Length, uint16_t* ID, MQTT::QoS QoS, bool Retain, bool DUP, uint16_t* Start, uint16_t* HeaderLength);
+
+        /** @brief              Store a copy of a publish message in the in-flight window and transmit the message.
+         *  @param Header       Pointer to fixed header, topic and message ID
+         *  @param HeaderLength Length of the header
+         *  @param Segments     Array with payload segments
+         *  @param Count        Number of payload segments
+         *  @param Length       Total length of the payload
+         *  @param Message      Pointer to in-flight entry. NULL for QoS 0 messages
+         *  @param QoS          Quality of service for the message
+         *  @param ID           Message ID
+         *  @return             Error code
+         */
+        MQTT::Error _transmitPublish(const uint8_t* Header, uint16_t HeaderLength, const MQTT::Segment* Segments, uint8_t Count, uint32_t Length, MQTT::Inflight* Message, MQTT::QoS QoS, uint16_t ID);
 
         /** @brief      Transmit a publish acknowledgement control package.
          *  @param ID   Message ID
@@ -395,17 +1040,109 @@ class MQTT
          */
         void _init(IPAddress IP, uint16_t Port, uint16_t KeepAlive, Publish_Callback Callback);
 
-        /** @brief          Copy an UTF-8 string into the transmit buffer.
-         *  @param String   UTF-8 string
-         *  @param Offset   Byte offset in the transmit buffer
+        /** @brief          Finish the current connection request.
+         *  @param Error    Result of the connection request
          */
-        void _copyString(const char* String, uint16_t* Offset);
+        void _finishConnect(MQTT::Error Error);
 
         /** @brief Increase the message ID.
          */
         void _increaseID(void);
 
-        /** @brief Send a ping control packet to the broker.
+        /** @brief  Start the acknowledge handling of a streamed QoS 1 or QoS 2 message after the last payload byte was transmitted.
+         */
+        void _completeStream(void);
+
+        /** @brief  Get a free entry from the in-flight window.
+         *  @return Pointer to entry or NULL if the window is full
+         */
+        MQTT::Inflight* _allocateInflight(void);
+
+        /** @brief          Find an in-flight message.
+         *  @param ID       Message ID
+         *  @param State    Expected state of the message
+         *  @return         Pointer to entry or NULL if no message was found
+         */
+        MQTT::Inflight* _findInflight(uint16_t ID, MQTT::InflightState State);
+
+        /** @brief          Transmit the unacknowledged messages again.
+         *                  NOTE: MQTT 5 only retransmits after a reconnect, so the timeout is only used with MQTT 3.1.1!
+         *  @param Force    Set to #true to transmit all messages without checking the timeout
+         *  @return         Error code
+         */
+        MQTT::Error _retransmit(bool Force);
+
+        /** @brief          Reserve a free queue entry.
+         *                  NOTE: Can be called from any thread!
+         *  @param Position Pointer to queue position of the entry
+         *  @return         Pointer to queue entry or NULL if the queue is full
+         */
+        MQTT::QueueEntry* _reserveQueue(uint32_t* Position);
+
+        /** @brief          Release a reserved queue entry for the network task.
+         *  @param Entry    Pointer to queue entry
+         *  @param Length   Length of the encoded message
+         *  @param Position Queue position of the entry
+         */
+        void _commitQueue(MQTT::QueueEntry* Entry, uint16_t Length, uint32_t Position);
+
+        /** @brief          Copy an encoded control packet into the queue.
+         *                  NOTE: Can be called from any thread!
+         *  @param Data     Pointer to control packet
+         *  @param Length   Length of the control packet
+         *  @return         Error code
+         */
+        MQTT::Error _enqueue(const uint8_t* Data, uint16_t Length);
+
+        /** @brief  Transmit all messages from the queue.
+         *  @return Error code
+         */
+        MQTT::Error _drainQueue(void);
+
+        /** @brief Schedule the next reconnect attempt when the reconnect budget isn´t exhausted.
+         */
+        void _scheduleReconnect(void);
+
+        /** @brief                  Transmit a subscribe control packet.
+         *  @param Subscriptions    Array with subscriptions
+         *  @param Count            Number of subscriptions
+         *  @param ID               Pointer to message ID. Can be NULL
+         *  @return                 Error code
+         */
+        MQTT::Error _sendSubscribe(const MQTT::Subscription* Subscriptions, uint8_t Count, uint16_t* ID);
+
+        /** @brief          Remove the request for a SUBACK or UNSUBACK from the list of pending requests.
+         *  @param Ack      Type of the acknowledge
+         *  @param ID       Message ID of the acknowledge
+         *  @param Count    Number of return codes in the acknowledge
+         *  @return         #true when the acknowledge matches a pending request
+         */
+        bool _completeRequest(MQTT::ControlPacket Ack, uint16_t ID, uint8_t Count);
+
+        /** @brief          Change the status of the client and report the change with the status callback.
+         *  @param Status   New status
+         *  @param Reason   Reason for the status change
+         */
+        void _setStatus(MQTT::Status Status, MQTT::Error Reason);
+
+        /** @brief          Close the connection after a lost link and report it with the status callback.
+         *  @param Reason   Reason for the link loss
+         */
+        void _linkLost(MQTT::Error Reason);
+
+        /** @brief          Count a transmitted control packet.
+         *  @param Header   First byte of the fixed header
+         */
+        void _countSent(uint8_t Header);
+
+        /** @brief              Add a sample to a latency histogram.
+         *  @param Histogram    Pointer to histogram
+         *  @param Time         Sample in ms
+         */
+        static void _addSample(MQTT::Histogram* Histogram, uint32_t Time);
+
+        /** @brief Keep-alive handler. Send a ping control packet to the broker when the client was idle for
+         *         half of the keep-alive time and detect a missing ping response.
          */
         void _sendPing(void);
 };
\ No newline at end of file
@@ -0,0 +1,210 @@
+/*
+ * MQTTClient.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Compile-time sized MQTT client for Particle IoT devices.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+#pragma once
+
+/** @file MQTT/MQTTClient.h
+ *  @brief Compile-time sized MQTT client. The buffer sizes, the size of the in-flight window and
+ *         the protocol version are template parameters, so each application only reserves the RAM it needs.
+ *         Use #MQTTClient::CanPublish and #MQTTClient::CanReceive with static_assert to check the messages
+ *         of the application at compile time:
+ *
+ *         typedef MQTTClient<64, 128, 2> Client;
+ *         static_assert(Client::CanPublish(sizeof("sensorhub/weather") - 1, 200), "Message doesn´t fit!");
+ *
+ *  @author Daniel Kampert
+ */
+
+#include "MQTT.h"
+
+/** @brief Storage for the buffers of a #MQTTClient. The storage is a base class of the client,
+ *         so it is initialized before the #MQTT base class uses it.
+ */
+template<uint16_t TxSize, uint16_t RxSize, uint8_t MaxInflight, uint16_t InflightSize, uint8_t QueueSize, uint16_t QueueEntrySize, uint16_t CorkSize>
+class MQTTBuffers
+{
+    protected:
+        uint8_t _mBuffer[TxSize];
+        uint8_t _mRxBuffer[RxSize];
+        uint8_t _mInflightBuffer[MaxInflight][InflightSize];
+        MQTT::Inflight _mInflight[MaxInflight];
+        uint8_t _mQueueBuffer[QueueSize][QueueEntrySize];
+        MQTT::QueueEntry _mQueue[QueueSize];
+        uint8_t _mCorkBuffer[CorkSize];
+
+        /** @brief          Get the buffer configuration for the #MQTT base class.
+         *  @param Version  MQTT protocol version
+         *  @return         Buffer configuration
+         */
+        MQTT::Storage _storage(uint8_t Version)
+        {
+            MQTT::Storage Storage;
+
+            for(uint8_t i = 0x00; i < MaxInflight; i++)
+            {
+                this->_mInflight[i].Packet = this->_mInflightBuffer[i];
+            }
+
+            for(uint8_t i = 0x00; i < QueueSize; i++)
+            {
+                this->_mQueue[i].Data = this->_mQueueBuffer[i];
+            }
+
+            Storage.Buffer = this->_mBuffer;
+            Storage.BufferSize = TxSize;
+            Storage.RxBuffer = this->_mRxBuffer;
+            Storage.RxBufferSize = RxSize;
+            Storage.InflightWindow = this->_mInflight;
+            Storage.MaxInflight = MaxInflight;
+            Storage.InflightSize = InflightSize;
+            Storage.Queue = this->_mQueue;
+            Storage.QueueSize = QueueSize;
+            Storage.QueueEntrySize = QueueEntrySize;
+            Storage.CorkBuffer = this->_mCorkBuffer;
+            Storage.CorkBufferSize = CorkSize;
+            Storage.Version = Version;
+
+            return Storage;
+        }
+};
+
+/** @brief MQTT client with compile-time sized buffers.
+ *  @tparam TxSize      Size of the transmit buffer (fixed header, variable header and the topic)
+ *  @tparam RxSize      Size of the receive ring buffer. Must be a power of two
+ *  @tparam MaxInflight Maximum number of unacknowledged QoS 1 and QoS 2 messages
+ *  @tparam Version     MQTT protocol version (#MQTT_VERSION_3_1, #MQTT_VERSION_3_1_1 or #MQTT_VERSION_5)
+ *  @tparam InflightSize Size of the packet buffer of each in-flight entry. Limits the size of QoS 1 and QoS 2 messages
+ *  @tparam QueueSize   Number of entries in the queue for messages from other threads. Must be a power of two
+ *  @tparam QueueEntrySize Size of a single queue entry. Limits the size of the messages from #MQTT::PublishAsync
+ *  @tparam CorkSize    Size of the staging buffer for corked transmissions
+ */
+template<uint16_t TxSize = MQTT_BUFFER_SIZE, uint16_t RxSize = MQTT_RX_BUFFER_SIZE, uint8_t MaxInflight = MQTT_MAX_INFLIGHT, uint8_t Version = MQTT_VERSION, uint16_t InflightSize = MQTT_INFLIGHT_BUFFER_SIZE,
+         uint8_t QueueSize = MQTT_QUEUE_SIZE, uint16_t QueueEntrySize = MQTT_QUEUE_ENTRY_SIZE, uint16_t CorkSize = MQTT_CORK_BUFFER_SIZE>
+class MQTTClient : private MQTTBuffers<TxSize, RxSize, MaxInflight, InflightSize, QueueSize, QueueEntrySize, CorkSize>, public MQTT
+{
+    // The transmit buffer must hold the fixed header and the variable header of a CONNECT packet (MQTT 3.1 uses 12 bytes, MQTT 5 uses 21 bytes with properties)
+    static_assert(TxSize >= (MQTT_FIXED_HEADER_SIZE + ((Version == MQTT_VERSION_5) ? 21 : 12) + 2), "TxSize is too small for a CONNECT packet!");
+    static_assert((RxSize >= 4) && ((RxSize & (RxSize - 1)) == 0), "RxSize must be a power of two!");
+    static_assert(MaxInflight > 0, "MaxInflight must be at least 1!");
+    static_assert(InflightSize >= (MQTT_FIXED_HEADER_SIZE + 0x04), "InflightSize is too small for a PUBLISH packet!");
+    static_assert((QueueSize > 0) && ((QueueSize & (QueueSize - 1)) == 0), "QueueSize must be a power of two!");
+    // The ping timer uses the queue for the PINGREQ packet
+    static_assert(QueueEntrySize >= 2, "QueueEntrySize is too small for a PINGREQ packet!");
+    static_assert(CorkSize > 0, "CorkSize must be at least 1!");
+    static_assert((Version == MQTT_VERSION_3_1) || (Version == MQTT_VERSION_3_1_1) || (Version == MQTT_VERSION_5), "Unsupported MQTT version!");
+
+    public:
+        /** @brief Constructor.
+         */
+        MQTTClient(void) : MQTT(this->_storage(Version), IPAddress(0, 0, 0, 0), 0, MQTT_DEFAULT_KEEPALIVE, NULL)
+        {
+        }
+
+        /** @brief      Constructor.
+         *  @param IP   IP address of the MQTT broker
+         */
+        MQTTClient(IPAddress IP) : MQTT(this->_storage(Version), IP, MQTT_DEFAULT_PORT, MQTT_DEFAULT_KEEPALIVE, NULL)
+        {
+        }
+
+        /** @brief      Constructor.
+         *  @param IP   IP address of the MQTT broker
+         *  @param Port	Port used by the MQTT client
+         */
+        MQTTClient(IPAddress IP, uint16_t Port) : MQTT(this->_storage(Version), IP, Port, MQTT_DEFAULT_KEEPALIVE, NULL)
+        {
+        }
+
+        /** @brief              Constructor.
+         *  @param IP           IP address of the MQTT broker
+         *  @param Port         Port used by the MQTT client
+         *  @param KeepAlive	Keep-alive time used by the MQTT client
+         */
+        MQTTClient(IPAddress IP, uint16_t Port, uint16_t KeepAlive) : MQTT(this->_storage(Version), IP, Port, KeepAlive, NULL)
+        {
+        }
+
+        /** @brief              Constructor.
+         *  @param IP           IP address of the MQTT broker
+         *  @param Port         Port used by the MQTT client
+         *  @param KeepAlive    Keep-alive time used by the MQTT client
+         *  @param Callback     Publish received callback
+         */
+        MQTTClient(IPAddress IP, uint16_t Port, uint16_t KeepAlive, Publish_Callback Callback) : MQTT(this->_storage(Version), IP, Port, KeepAlive, Callback)
+        {
+        }
+
+        /** @brief                  Get the size of a complete PUBLISH packet.
+         *  @param TopicLength      Length of the topic
+         *  @param PayloadLength    Length of the payload
+         *  @param QoS              Quality of service
+         *  @return                 Packet size in bytes
+         */
+        static constexpr uint32_t PublishSize(uint16_t TopicLength, uint32_t PayloadLength, MQTT::QoS QoS)
+        {
+            return 0x01 + MQTTClient::_lengthSize(MQTTClient::_remainingLength(TopicLength, PayloadLength, QoS)) + MQTTClient::_remainingLength(TopicLength, PayloadLength, QoS);
+        }
+
+        /** @brief                  Check if the client can transmit a PUBLISH packet.
+         *                          QoS 1 and QoS 2 messages must fit into the in-flight buffer for retransmissions.
+         *  @param TopicLength      Length of the topic
+         *  @param PayloadLength    Length of the payload
+         *  @param QoS              Quality of service
+         *  @return                 #true when the packet can be transmitted
+         */
+        static constexpr bool CanPublish(uint16_t TopicLength, uint32_t PayloadLength, MQTT::QoS QoS = MQTT::QOS_0)
+        {
+            return (MQTTClient::_remainingLength(TopicLength, PayloadLength, QoS) <= MQTT_MAX_REMAINING_LENGTH) &&
+                   ((MQTT_FIXED_HEADER_SIZE + 0x02 + TopicLength + ((QoS != MQTT::QOS_0) ? 0x02 : 0x00) + MQTTClient::_propertySize()) <= TxSize) &&
+                   ((QoS == MQTT::QOS_0) || (MQTTClient::PublishSize(TopicLength, PayloadLength, QoS) <= InflightSize));
+        }
+
+        /** @brief                  Check if the client can receive a PUBLISH packet. Larger packets are discarded.
+         *  @param TopicLength      Length of the topic
+         *  @param PayloadLength    Length of the payload
+         *  @param QoS              Quality of service
+         *  @return                 #true when the packet can be received
+         */
+        static constexpr bool CanReceive(uint16_t TopicLength, uint32_t PayloadLength, MQTT::QoS QoS = MQTT::QOS_0)
+        {
+            return MQTTClient::PublishSize(TopicLength, PayloadLength, QoS) <= RxSize;
+        }
+
+    private:
+        static constexpr uint32_t _remainingLength(uint16_t TopicLength, uint32_t PayloadLength, MQTT::QoS QoS)
+        {
+            return 0x02 + TopicLength + ((QoS != MQTT::QOS_0) ? 0x02 : 0x00) + MQTTClient::_propertySize() + PayloadLength;
+        }
+
+        // MQTT 5 adds the property length and optionally a topic alias to each PUBLISH
+        static constexpr uint8_t _propertySize(void)
+        {
+            return (Version == MQTT_VERSION_5) ? 0x04 : 0x00;
+        }
+
+        static constexpr uint8_t _lengthSize(uint32_t RemainingLength)
+        {
+            return (RemainingLength < 128UL) ? 0x01 : (RemainingLength < 16384UL) ? 0x02 : (RemainingLength < 2097152UL) ? 0x03 : 0x04;
+        }
+};
@@ -0,0 +1,737 @@
+/*
+ * MQTTCodec.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Transport independent encoder and decoder for MQTT control packets.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTTCodec.cpp
+ *  @brief Encoder and decoder for MQTT control packets.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include "MQTTCodec.h"
+
+uint8_t MQTTCodec::LengthSize(uint32_t Length)
+{
+    return (Length < 128UL) ? 0x01 : (Length < 16384UL) ? 0x02 : (Length < 2097152UL) ? 0x03 : 0x04;
+}
+
+uint8_t MQTTCodec::EncodeLength(uint8_t* Buffer, uint32_t Length)
+{
+    uint8_t Bytes = 0x00;
+
+    do
+    {
+        uint8_t EncodedByte = Length % 0x80;
+        Length = Length >> 0x07;
+        if(Length > 0x00)
+        {
+            EncodedByte |= 0x80;
+        }
+
+        Buffer[Bytes++] = EncodedByte;
+    } while((Length > 0x00) && (Bytes < 0x04));
+
+    return Bytes;
+}
+
+MQTTCodec::Error MQTTCodec::DecodeLength(const MQTTCodec::Reader& Reader, uint16_t Offset, uint32_t* Length, uint8_t* Bytes)
+{
+    uint8_t EncodedByte;
+
+    *Length = 0x00;
+    *Bytes = 0x00;
+
+    do
+    {
+        if((Offset + *Bytes) >= Reader.Length)
+        {
+            return INCOMPLETE;
+        }
+
+        EncodedByte = MQTTCodec::_peek(Reader, Offset + *Bytes);
+        *Length |= (uint32_t)(EncodedByte & 0x7F) << (0x07 * *Bytes);
+        (*Bytes)++;
+    } while((EncodedByte & 0x80) && (*Bytes < 0x04));
+
+    // The integer is encoded with a maximum of 4 bytes
+    if(EncodedByte & 0x80)
+    {
+        return MALFORMED;
+    }
+
+    return NO_ERROR;
+}
+
+uint16_t MQTTCodec::EncodeFixedHeader(uint8_t* Buffer, uint8_t Type, uint8_t Flags, uint32_t RemainingLength)
+{
+    uint8_t SizeBytes = MQTTCodec::LengthSize(RemainingLength);
+
+    // Store the header and the flags directly in front of the encoded length
+    Buffer[MQTT_FIXED_HEADER_SIZE - SizeBytes - 0x01] = (Type << 0x04) | (Flags & 0x0F);
+    MQTTCodec::EncodeLength(Buffer + MQTT_FIXED_HEADER_SIZE - SizeBytes, RemainingLength);
+
+    return MQTT_FIXED_HEADER_SIZE - SizeBytes - 0x01;
+}
+
+MQTTCodec::Error MQTTCodec::EncodeString(uint8_t* Buffer, uint16_t Size, uint16_t* Offset, const char* String)
+{
+    size_t StringLength;
+
+    if(String == NULL)
+    {
+        return INVALID_PARAMETER;
+    }
+
+    StringLength = strlen(String);
+    if((StringLength > 0xFFFF) || ((*Offset + sizeof(uint16_t) + StringLength) > Size))
+    {
+        return BUFFER_OVERFLOW;
+    }
+
+    Buffer[(*Offset)++] = (StringLength >> 0x08);
+    Buffer[(*Offset)++] = (StringLength & 0xFF);
+    memcpy(Buffer + *Offset, String, StringLength);
+    *Offset += StringLength;
+
+    return NO_ERROR;
+}
+
+MQTTCodec::Error MQTTCodec::EncodeConnect(uint8_t* Buffer, uint16_t Size, uint8_t Version, const MQTTCodec::ConnectOptions& Options, uint16_t* Start, uint16_t* Length)
+{
+    MQTTCodec::Error Error;
+    uint8_t Flags = 0x00;
+    uint16_t Offset = MQTT_FIXED_HEADER_SIZE;
+
+    if((Options.ClientID == NULL) || (Options.WillTopic && (Options.WillMessage == NULL)) || (Options.Password && (Options.UserName == NULL)))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    // Protocol name, protocol level, flags, keep alive and the largest property block
+    if((MQTT_FIXED_HEADER_SIZE + 0x09 + 0x03 + ((Version == MQTT_VERSION_5) ? 0x0B : 0x00)) > Size)
+    {
+        return BUFFER_OVERFLOW;
+    }
+
+    // Set the protocol name and the protocol level
+    if(Version == MQTT_VERSION_3_1)
+    {
+        const uint8_t Header[] = {0x00, 0x06, 'M', 'Q', 'I', 's', 'd', 'p', MQTT_VERSION_3_1};
+
+        memcpy(Buffer + Offset, Header, sizeof(Header));
+        Offset += sizeof(Header);
+    }
+    else
+    {
+        // MQTT 3.1.1 and MQTT 5 use the same protocol name
+        const uint8_t Header[] = {0x00, 0x04, 'M', 'Q', 'T', 'T', Version};
+
+        memcpy(Buffer + Offset, Header, sizeof(Header));
+        Offset += sizeof(Header);
+    }
+
+    Flags |= ((uint8_t)Options.CleanSession) << 0x01;
+
+    if(Options.WillTopic)
+    {
+        Flags |= (((uint8_t)Options.WillRetain) << 0x05) | ((Options.WillQoS & 0x03) << 0x03) | (0x01 << 0x02);
+    }
+
+    if(Options.UserName)
+    {
+        Flags |= (0x01 << 0x07);
+    }
+
+    if(Options.Password)
+    {
+        Flags |= (0x01 << 0x06);
+    }
+
+    // Set the flags
+    Buffer[Offset++] = Flags;
+
+    // Set keep alive
+    Buffer[Offset++] = (Options.KeepAlive >> 0x08);
+    Buffer[Offset++] = (Options.KeepAlive & 0xFF);
+
+    // Set the connect properties
+    if(Version == MQTT_VERSION_5)
+    {
+        uint16_t PropertyLength = Offset++;
+
+        // The broker must not send packets which doesn´t fit into the receive buffer of the client
+        if(Options.MaximumPacketSize)
+        {
+            Buffer[Offset++] = PROPERTY_MAXIMUM_PACKET_SIZE;
+            Buffer[Offset++] = (Options.MaximumPacketSize >> 0x18);
+            Buffer[Offset++] = (Options.MaximumPacketSize >> 0x10) & 0xFF;
+            Buffer[Offset++] = (Options.MaximumPacketSize >> 0x08) & 0xFF;
+            Buffer[Offset++] = (Options.MaximumPacketSize & 0xFF);
+        }
+
+        // MQTT 5 ends the session with the connection by default. Keep the session like MQTT 3.1.1 does
+        if(!Options.CleanSession)
+        {
+            Buffer[Offset++] = PROPERTY_SESSION_EXPIRY_INTERVAL;
+            Buffer[Offset++] = 0xFF;
+            Buffer[Offset++] = 0xFF;
+            Buffer[Offset++] = 0xFF;
+            Buffer[Offset++] = 0xFF;
+        }
+
+        Buffer[PropertyLength] = Offset - PropertyLength - 0x01;
+    }
+
+    // Set the client ID
+    Error = MQTTCodec::EncodeString(Buffer, Size, &Offset, Options.ClientID);
+    if(Error)
+    {
+        return Error;
+    }
+
+    // Set the will configuration
+    if(Options.WillTopic)
+    {
+        // MQTT 5 needs the length of the will properties
+        if(Version == MQTT_VERSION_5)
+        {
+            if(Offset >= Size)
+            {
+                return BUFFER_OVERFLOW;
+            }
+
+            Buffer[Offset++] = 0x00;
+        }
+
+        Error = MQTTCodec::EncodeString(Buffer, Size, &Offset, Options.WillTopic);
+        if(Error)
+        {
+            return Error;
+        }
+
+        Error = MQTTCodec::EncodeString(Buffer, Size, &Offset, Options.WillMessage);
+        if(Error)
+        {
+            return Error;
+        }
+    }
+
+    // Set the user configuration
+    if(Options.UserName)
+    {
+        Error = MQTTCodec::EncodeString(Buffer, Size, &Offset, Options.UserName);
+        if(Error)
+        {
+            return Error;
+        }
+    }
+
+    if(Options.Password)
+    {
+        if((Offset + sizeof(uint16_t) + Options.PasswordLength) > Size)
+        {
+            return BUFFER_OVERFLOW;
+        }
+
+        Buffer[Offset++] = (Options.PasswordLength >> 0x08);
+        Buffer[Offset++] = (Options.PasswordLength & 0xFF);
+        memcpy(Buffer + Offset, Options.Password, Options.PasswordLength);
+        Offset += Options.PasswordLength;
+    }
+
+    *Start = MQTTCodec::EncodeFixedHeader(Buffer, CONNECT, 0x00, Offset - MQTT_FIXED_HEADER_SIZE);
+    *Length = Offset - *Start;
+
+    return NO_ERROR;
+}
+
+MQTTCodec::Error MQTTCodec::EncodePublish(uint8_t* Buffer, uint16_t Size, uint8_t Version, const MQTTCodec::PublishOptions& Options, uint32_t PayloadLength, uint16_t* Start, uint16_t* Length)
+{
+    MQTTCodec::Error Error;
+    uint16_t Offset = MQTT_FIXED_HEADER_SIZE;
+
+    if(Options.QoS > 0x02)
+    {
+        return INVALID_PARAMETER;
+    }
+
+    // Copy the topic into the buffer
+    Error = MQTTCodec::EncodeString(Buffer, Size, &Offset, Options.Topic);
+    if(Error)
+    {
+        return Error;
+    }
+
+    // Quality of service 1 and 2 need a packet identifier
+    if(Options.QoS != 0x00)
+    {
+        if((Offset + sizeof(uint16_t)) > Size)
+        {
+            return BUFFER_OVERFLOW;
+        }
+
+        Buffer[Offset++] = (Options.ID >> 0x08);
+        Buffer[Offset++] = (Options.ID & 0xFF);
+    }
+
+    // MQTT 5 needs the publish properties
+    if(Version == MQTT_VERSION_5)
+    {
+        if((Offset + 0x04) > Size)
+        {
+            return BUFFER_OVERFLOW;
+        }
+
+        Offset += MQTTCodec::EncodePublishProperties(Buffer + Offset, Options.Alias);
+    }
+
+    if(PayloadLength > (MQTT_MAX_REMAINING_LENGTH - (Offset - MQTT_FIXED_HEADER_SIZE)))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    *Start = MQTTCodec::EncodeFixedHeader(Buffer, PUBLISH, ((uint8_t)Options.Retain) | ((Options.QoS & 0x03) << 0x01) | (((uint8_t)Options.DUP) << 0x03), Offset - MQTT_FIXED_HEADER_SIZE + PayloadLength);
+    *Length = Offset - *Start;
+
+    return NO_ERROR;
+}
+
+uint8_t MQTTCodec::EncodePublishProperties(uint8_t* Buffer, uint16_t Alias)
+{
+    if(Alias)
+    {
+        Buffer[0] = 0x03;
+        Buffer[1] = PROPERTY_TOPIC_ALIAS;
+        Buffer[2] = (Alias >> 0x08);
+        Buffer[3] = (Alias & 0xFF);
+
+        return 0x04;
+    }
+
+    Buffer[0] = 0x00;
+
+    return 0x01;
+}
+
+MQTTCodec::Error MQTTCodec::EncodeSubscribe(uint8_t* Buffer, uint16_t Size, uint8_t Version, uint16_t ID, const MQTTCodec::TopicFilter* Filters, uint8_t Count, uint16_t* Start, uint16_t* Length)
+{
+    MQTTCodec::Error Error;
+    uint16_t Offset = MQTT_FIXED_HEADER_SIZE;
+
+    // The payload must contain at least one topic filter
+    if((Filters == NULL) || (Count == 0x00))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    if((MQTT_FIXED_HEADER_SIZE + 0x03) > Size)
+    {
+        return BUFFER_OVERFLOW;
+    }
+
+    // Set the message ID
+    Buffer[Offset++] = (ID >> 0x08);
+    Buffer[Offset++] = (ID & 0xFF);
+
+    // MQTT 5 needs the length of the subscribe properties
+    if(Version == MQTT_VERSION_5)
+    {
+        Buffer[Offset++] = 0x00;
+    }
+
+    for(uint8_t i = 0x00; i < Count; i++)
+    {
+        // Copy the topic into the buffer
+        Error = MQTTCodec::EncodeString(Buffer, Size, &Offset, Filters[i].Topic);
+        if(Error)
+        {
+            return Error;
+        }
+
+        if(Offset >= Size)
+        {
+            return BUFFER_OVERFLOW;
+        }
+
+        // Write the QoS into the buffer. MQTT 5 uses the same bits for the QoS in the subscription options
+        Buffer[Offset++] = Filters[i].QoS & 0x03;
+    }
+
+    *Start = MQTTCodec::EncodeFixedHeader(Buffer, SUBSCRIBE, (0x01 << 0x01), Offset - MQTT_FIXED_HEADER_SIZE);
+    *Length = Offset - *Start;
+
+    return NO_ERROR;
+}
+
+MQTTCodec::Error MQTTCodec::EncodeUnsubscribe(uint8_t* Buffer, uint16_t Size, uint8_t Version, uint16_t ID, const char* const* Topics, uint8_t Count, uint16_t* Start, uint16_t* Length)
+{
+    MQTTCodec::Error Error;
+    uint16_t Offset = MQTT_FIXED_HEADER_SIZE;
+
+    // The payload must contain at least one topic filter
+    if((Topics == NULL) || (Count == 0x00))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    if((MQTT_FIXED_HEADER_SIZE + 0x03) > Size)
+    {
+        return BUFFER_OVERFLOW;
+    }
+
+    // Set the message ID
+    Buffer[Offset++] = (ID >> 0x08);
+    Buffer[Offset++] = (ID & 0xFF);
+
+    // MQTT 5 needs the length of the unsubscribe properties
+    if(Version == MQTT_VERSION_5)
+    {
+        Buffer[Offset++] = 0x00;
+    }
+
+    // Copy the topics into the buffer
+    for(uint8_t i = 0x00; i < Count; i++)
+    {
+        Error = MQTTCodec::EncodeString(Buffer, Size, &Offset, Topics[i]);
+        if(Error)
+        {
+            return Error;
+        }
+    }
+
+    *Start = MQTTCodec::EncodeFixedHeader(Buffer, UNSUBSCRIBE, (0x01 << 0x01), Offset - MQTT_FIXED_HEADER_SIZE);
+    *Length = Offset - *Start;
+
+    return NO_ERROR;
+}
+
+uint8_t MQTTCodec::EncodeAck(uint8_t* Buffer, uint8_t Type, uint16_t ID)
+{
+    // Only PUBREL uses the reserved flags
+    Buffer[0] = (Type << 0x04) | ((Type == PUBREL) ? (0x01 << 0x01) : 0x00);
+    Buffer[1] = 0x02;
+    Buffer[2] = (ID >> 0x08);
+    Buffer[3] = (ID & 0xFF);
+
+    return 0x04;
+}
+
+MQTTCodec::Error MQTTCodec::DecodeFixedHeader(const MQTTCodec::Reader& Reader, MQTTCodec::FixedHeader* Header)
+{
+    MQTTCodec::Error Error;
+    uint8_t Bytes;
+
+    if(Reader.Length == 0x00)
+    {
+        return INCOMPLETE;
+    }
+
+    Header->Type = MQTTCodec::_peek(Reader, 0) >> 0x04;
+    Header->Flags = MQTTCodec::_peek(Reader, 0) & 0x0F;
+
+    Error = MQTTCodec::DecodeLength(Reader, 0x01, &Header->RemainingLength, &Bytes);
+    Header->Size = 0x01 + Bytes;
+
+    return Error;
+}
+
+MQTTCodec::Error MQTTCodec::DecodeConnack(const MQTTCodec::Reader& Reader, uint8_t Version, uint8_t HeaderSize, MQTTCodec::Connack* Connack)
+{
+    uint8_t Bytes;
+    uint32_t PropertyLength;
+    uint16_t Offset = HeaderSize + 0x02;
+    uint16_t End = Reader.Length;
+
+    if(Offset > Reader.Length)
+    {
+        return MALFORMED;
+    }
+
+    // Use the protocol defaults when the broker doesn´t report its limits
+    Connack->SessionPresent = MQTTCodec::_peek(Reader, HeaderSize) & 0x01;
+    Connack->ReturnCode = MQTTCodec::_peek(Reader, HeaderSize + 0x01);
+    Connack->ReceiveMaximum = 0xFFFF;
+    Connack->TopicAliasMaximum = 0x00;
+    Connack->MaximumPacketSize = 0xFFFFFFFF;
+
+    if((Version != MQTT_VERSION_5) || (Offset == Reader.Length))
+    {
+        return NO_ERROR;
+    }
+
+    if(MQTTCodec::DecodeLength(Reader, Offset, &PropertyLength, &Bytes))
+    {
+        return MALFORMED;
+    }
+
+    Offset += Bytes;
+    if((Offset + PropertyLength) < End)
+    {
+        End = Offset + PropertyLength;
+    }
+
+    // Process the limits of the broker and skip all other properties
+    while(Offset < End)
+    {
+        uint8_t Property = MQTTCodec::_peek(Reader, Offset++);
+        uint16_t Size = MQTTCodec::_propertySize(Reader, Property, Offset);
+
+        // The remaining properties can´t be parsed without the size
+        if((Size == 0x00) || ((Offset + Size) > End))
+        {
+            break;
+        }
+
+        switch(Property)
+        {
+            case(PROPERTY_RECEIVE_MAXIMUM):
+            {
+                Connack->ReceiveMaximum = MQTTCodec::_peekInteger(Reader, Offset);
+
+                // A receive maximum of 0 is a protocol error
+                if(Connack->ReceiveMaximum == 0x00)
+                {
+                    return MALFORMED;
+                }
+
+                break;
+            }
+            case(PROPERTY_TOPIC_ALIAS_MAXIMUM):
+            {
+                Connack->TopicAliasMaximum = MQTTCodec::_peekInteger(Reader, Offset);
+
+                break;
+            }
+            case(PROPERTY_MAXIMUM_PACKET_SIZE):
+            {
+                Connack->MaximumPacketSize = ((uint32_t)MQTTCodec::_peekInteger(Reader, Offset) << 0x10) | MQTTCodec::_peekInteger(Reader, Offset + 0x02);
+
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+
+        Offset += Size;
+    }
+
+    return NO_ERROR;
+}
+
+MQTTCodec::Error MQTTCodec::DecodePublish(const MQTTCodec::Reader& Reader, uint8_t Version, uint8_t HeaderSize, MQTTCodec::PublishInfo* Publish)
+{
+    uint16_t Offset = HeaderSize + 0x02;
+    uint8_t Flags = MQTTCodec::_peek(Reader, 0);
+
+    Publish->QoS = (Flags >> 0x01) & 0x03;
+    Publish->Retain = Flags & 0x01;
+    Publish->DUP = (Flags >> 0x03) & 0x01;
+    Publish->ID = 0x00;
+
+    if((Publish->QoS > 0x02) || (Offset > Reader.Length))
+    {
+        return MALFORMED;
+    }
+
+    Publish->TopicOffset = Offset;
+    Publish->TopicLength = MQTTCodec::_peekInteger(Reader, HeaderSize);
+
+    // The topic must be part of the packet
+    if(Publish->TopicLength > (Reader.Length - Offset))
+    {
+        return MALFORMED;
+    }
+
+    Offset += Publish->TopicLength;
+
+    // QoS 1 and QoS 2 messages contain a message ID
+    if(Publish->QoS != 0x00)
+    {
+        if((Offset + sizeof(uint16_t)) > Reader.Length)
+        {
+            return MALFORMED;
+        }
+
+        Publish->ID = MQTTCodec::_peekInteger(Reader, Offset);
+        Offset += sizeof(uint16_t);
+    }
+
+    // Skip the publish properties
+    if(Version == MQTT_VERSION_5)
+    {
+        uint8_t Bytes;
+        uint32_t PropertyLength;
+
+        if(MQTTCodec::DecodeLength(Reader, Offset, &PropertyLength, &Bytes))
+        {
+            return MALFORMED;
+        }
+
+        Offset += Bytes;
+        if(PropertyLength > (uint32_t)(Reader.Length - Offset))
+        {
+            return MALFORMED;
+        }
+
+        Offset += PropertyLength;
+    }
+
+    if(Offset > Reader.Length)
+    {
+        return MALFORMED;
+    }
+
+    Publish->PayloadOffset = Offset;
+
+    return NO_ERROR;
+}
+
+MQTTCodec::Error MQTTCodec::DecodeAck(const MQTTCodec::Reader& Reader, uint8_t Version, uint8_t HeaderSize, MQTTCodec::Ack* Ack)
+{
+    if((HeaderSize + sizeof(uint16_t)) > Reader.Length)
+    {
+        return MALFORMED;
+    }
+
+    Ack->ID = MQTTCodec::_peekInteger(Reader, HeaderSize);
+    Ack->ReasonCode = 0x00;
+
+    // The reason code is omitted when the remaining length is 2
+    if((Version == MQTT_VERSION_5) && ((HeaderSize + sizeof(uint16_t)) < Reader.Length))
+    {
+        Ack->ReasonCode = MQTTCodec::_peek(Reader, HeaderSize + sizeof(uint16_t));
+    }
+
+    return NO_ERROR;
+}
+
+MQTTCodec::Error MQTTCodec::DecodeSubscribeAck(const MQTTCodec::Reader& Reader, uint8_t Version, uint8_t HeaderSize, uint16_t* ID, uint8_t* Codes, uint8_t Size, uint8_t* Count)
+{
+    uint16_t Offset = HeaderSize + sizeof(uint16_t);
+
+    *Count = 0x00;
+
+    if(Offset > Reader.Length)
+    {
+        return MALFORMED;
+    }
+
+    *ID = MQTTCodec::_peekInteger(Reader, HeaderSize);
+
+    // MQTT 5 places the properties in front of the reason codes
+    if(Version == MQTT_VERSION_5)
+    {
+        uint8_t Bytes;
+        uint32_t PropertyLength;
+
+        if(MQTTCodec::DecodeLength(Reader, Offset, &PropertyLength, &Bytes))
+        {
+            return MALFORMED;
+        }
+
+        Offset += Bytes;
+        if(PropertyLength > (uint32_t)(Reader.Length - Offset))
+        {
+            return MALFORMED;
+        }
+
+        Offset += PropertyLength;
+    }
+
+    // Each topic filter of the request gets a return code in the same order
+    while(Offset < Reader.Length)
+    {
+        // The packet contains more return codes than the caller can store
+        if(*Count == Size)
+        {
+            return BUFFER_OVERFLOW;
+        }
+
+        Codes[(*Count)++] = MQTTCodec::_peek(Reader, Offset++);
+    }
+
+    return NO_ERROR;
+}
+
+uint8_t MQTTCodec::_peek(const MQTTCodec::Reader& Reader, uint16_t Offset)
+{
+    return Reader.Buffer[(Reader.Start + Offset) & Reader.Mask];
+}
+
+uint16_t MQTTCodec::_peekInteger(const MQTTCodec::Reader& Reader, uint16_t Offset)
+{
+    return (MQTTCodec::_peek(Reader, Offset) << 0x08) | MQTTCodec::_peek(Reader, Offset + 0x01);
+}
+
+uint16_t MQTTCodec::_propertySize(const MQTTCodec::Reader& Reader, uint8_t Property, uint16_t Offset)
+{
+    switch(Property)
+    {
+        // Byte
+        case(0x01): case(0x17): case(0x19): case(0x24): case(0x25): case(0x28): case(0x29): case(0x2A):
+        {
+            return 0x01;
+        }
+        // Two byte integer
+        case(0x13): case(0x21): case(0x22): case(0x23):
+        {
+            return 0x02;
+        }
+        // Four byte integer
+        case(0x02): case(0x11): case(0x18): case(0x27):
+        {
+            return 0x04;
+        }
+        // Variable byte integer
+        case(0x0B):
+        {
+            uint8_t Bytes;
+            uint32_t Value;
+
+            if(MQTTCodec::DecodeLength(Reader, Offset, &Value, &Bytes))
+            {
+                return 0x00;
+            }
+
+            return Bytes;
+        }
+        // UTF-8 string or binary data
+        case(0x03): case(0x08): case(0x09): case(0x12): case(0x15): case(0x16): case(0x1A): case(0x1C): case(0x1F):
+        {
+            return 0x02 + MQTTCodec::_peekInteger(Reader, Offset);
+        }
+        // UTF-8 string pair
+        case(0x26):
+        {
+            uint16_t Length = 0x02 + MQTTCodec::_peekInteger(Reader, Offset);
+
+            return Length + 0x02 + MQTTCodec::_peekInteger(Reader, Offset + Length);
+        }
+        default:
+        {
+            return 0x00;
+        }
+    }
+}
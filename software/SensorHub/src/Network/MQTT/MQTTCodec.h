@@ -0,0 +1,367 @@
+/*
+ * MQTTCodec.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Transport independent encoder and decoder for MQTT control packets.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+#pragma once
+
+/** @file MQTT/MQTTCodec.h
+ *  @brief Encoder and decoder for MQTT 3.1, MQTT 3.1.1 and MQTT 5 control packets.
+ *         The codec only works on memory buffers and doesn´t use the Device OS, so it can be
+ *         compiled and profiled on a host computer:
+ *
+ *         g++ -std=gnu++14 -c MQTT/MQTTCodec.cpp
+ *
+ *         The host build in SensorHub/Host contains a benchmark for the codec.
+ *
+ *         The encoders use the layout of the transmit buffer of the #MQTT client. The message starts at
+ *         offset #MQTT_FIXED_HEADER_SIZE and the fixed header is placed directly in front of the message,
+ *         so a packet is encoded without moving the message. The decoders read from a #MQTTCodec::Reader,
+ *         which covers linear buffers and the receive ring buffer of the client.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+class MQTTCodec
+{
+    public:
+        /** @brief Constant for MQTT version 3.1.1.
+         */
+        #define MQTT_VERSION_3_1_1                      0x04
+
+        /** @brief Constant for MQTT version 3.1.
+         */
+        #define MQTT_VERSION_3_1                        0x03
+
+        /** @brief Constant for MQTT version 5.
+         */
+        #define MQTT_VERSION_5                          0x05
+
+        /** @brief Size of the fixed header.
+         */
+        #define MQTT_FIXED_HEADER_SIZE                  0x05
+
+        /** @brief Maximum value for the remaining length field of a MQTT control packet (4 bytes encoded).
+         */
+        #define MQTT_MAX_REMAINING_LENGTH               268435455UL
+
+        /** @brief Codec error codes.
+         */
+        typedef enum
+        {
+            NO_ERROR = 0x00,							        /**< No error. */
+            INVALID_PARAMETER = 0x01,							/**< Invalid function parameter. */
+            BUFFER_OVERFLOW = 0x02,							    /**< The packet doesn´t fit into the buffer. */
+            INCOMPLETE = 0x03,							        /**< More bytes are needed to decode the packet. */
+            MALFORMED = 0x04,							        /**< The packet violates the protocol. */
+        } Error;
+
+        /** @brief MQTT control packets.
+         */
+        typedef enum
+        {
+            CONNECT = 0x01,
+            CONNACK = 0x02,
+            PUBLISH = 0x03,
+            PUBACK = 0x04,
+            PUBREC = 0x05,
+            PUBREL = 0x06,
+            PUBCOMP = 0x07,
+            SUBSCRIBE = 0x08,
+            SUBACK = 0x09,
+            UNSUBSCRIBE = 0x0A,
+            UNSUBACK = 0x0B,
+            PINGREQ = 0x0C,
+            PINGRESP = 0x0D,
+            DISCONNECT = 0x0E,
+        } PacketType;
+
+        /** @brief MQTT 5 property identifiers used by the codec.
+         */
+        typedef enum
+        {
+            PROPERTY_SESSION_EXPIRY_INTERVAL = 0x11,
+            PROPERTY_RECEIVE_MAXIMUM = 0x21,
+            PROPERTY_TOPIC_ALIAS_MAXIMUM = 0x22,
+            PROPERTY_TOPIC_ALIAS = 0x23,
+            PROPERTY_MAXIMUM_PACKET_SIZE = 0x27,
+        } Property;
+
+        /** @brief Content of a CONNECT packet.
+         */
+        typedef struct
+        {
+            const char* ClientID;							    /**< UTF-8 encoded client identifier. */
+            bool CleanSession;							        /**< Start a new session. */
+            uint16_t KeepAlive;							        /**< Keep-alive time in seconds. */
+            const char* WillTopic;							    /**< Topic of the Will. NULL when the client doesn´t use a Will. */
+            const char* WillMessage;							/**< Message of the Will. */
+            uint8_t WillQoS;							        /**< Quality of service for the Will. */
+            bool WillRetain;							        /**< Retain flag for the Will. */
+            const char* UserName;							    /**< User name. NULL when the client doesn´t use a user name. */
+            const uint8_t* Password;							/**< User password. NULL when the client doesn´t use a password. */
+            uint16_t PasswordLength;							/**< Length of the user password. */
+            uint32_t MaximumPacketSize;							/**< Maximum packet size of the client (MQTT 5 only). 0 to omit the property. */
+        } ConnectOptions;
+
+        /** @brief Content of the header of a PUBLISH packet.
+         */
+        typedef struct
+        {
+            const char* Topic;							        /**< MQTT topic. Can be empty when a topic alias is used. */
+            uint16_t ID;							            /**< Message ID. Only used for QoS 1 and QoS 2. */
+            uint8_t QoS;							            /**< Quality of service. */
+            bool Retain;							            /**< Retain flag for the broker. */
+            bool DUP;							                /**< DUP flag for the broker. */
+            uint16_t Alias;							            /**< Topic alias (MQTT 5 only). 0 when the message doesn´t use an alias. */
+        } PublishOptions;
+
+        /** @brief Topic filter of a SUBSCRIBE packet.
+         */
+        typedef struct
+        {
+            const char* Topic;							        /**< Topic filter. */
+            uint8_t QoS;							            /**< Maximum quality of service for the topic. */
+        } TopicFilter;
+
+        /** @brief Read access to a received packet. The byte at offset n is stored in
+         *         Buffer[(Start + n) & Mask], so a ring buffer with a size of a power of two can be used directly.
+         *         NOTE: Use a mask of 0xFFFF and a start of 0 for linear buffers!
+         */
+        typedef struct
+        {
+            const uint8_t* Buffer;							    /**< Pointer to buffer. */
+            uint16_t Start;							            /**< Offset of the first byte of the packet in the buffer. */
+            uint16_t Mask;							            /**< Size of the ring buffer - 1. */
+            uint16_t Length;							        /**< Number of available bytes. */
+        } Reader;
+
+        /** @brief Decoded fixed header.
+         */
+        typedef struct
+        {
+            uint8_t Type;							            /**< Control packet type. */
+            uint8_t Flags;							            /**< Flags of the control packet. */
+            uint8_t Size;							            /**< Size of the fixed header in bytes. */
+            uint32_t RemainingLength;							/**< Length of the packet without the fixed header. */
+        } FixedHeader;
+
+        /** @brief Decoded CONNACK packet. The limits are set to the protocol defaults when the broker doesn´t report them.
+         */
+        typedef struct
+        {
+            bool SessionPresent;							    /**< The broker has restored the previous session. */
+            uint8_t ReturnCode;							        /**< Connect return code (MQTT 3.1.1) or reason code (MQTT 5). */
+            uint16_t ReceiveMaximum;							/**< Maximum number of unacknowledged QoS 1 and QoS 2 messages. */
+            uint16_t TopicAliasMaximum;							/**< Highest topic alias accepted by the broker. */
+            uint32_t MaximumPacketSize;							/**< Maximum packet size accepted by the broker. */
+        } Connack;
+
+        /** @brief Decoded PUBLISH packet. The topic and the payload are referenced by their offset in the packet.
+         */
+        typedef struct
+        {
+            uint16_t TopicOffset;							    /**< Offset of the topic. */
+            uint16_t TopicLength;							    /**< Length of the topic. */
+            uint16_t ID;							            /**< Message ID. 0 for QoS 0 messages. */
+            uint8_t QoS;							            /**< Quality of service. */
+            bool Retain;							            /**< Retain flag. */
+            bool DUP;							                /**< DUP flag. */
+            uint16_t PayloadOffset;							    /**< Offset of the payload. The payload ends with the packet. */
+        } PublishInfo;
+
+        /** @brief Decoded PUBACK, PUBREC, PUBREL or PUBCOMP packet.
+         */
+        typedef struct
+        {
+            uint16_t ID;							            /**< Message ID. */
+            uint8_t ReasonCode;							        /**< Reason code (MQTT 5 only). 0 when the reason code is omitted. */
+        } Ack;
+
+        /** @brief          Get the number of bytes of an encoded remaining length.
+         *  @param Length   Remaining length
+         *  @return         Number of bytes (1 - 4)
+         */
+        static uint8_t LengthSize(uint32_t Length);
+
+        /** @brief          Encode a remaining length or a variable byte integer.
+         *  @param Buffer   Pointer to buffer with space for 4 bytes
+         *  @param Length   Value
+         *  @return         Number of bytes written
+         */
+        static uint8_t EncodeLength(uint8_t* Buffer, uint32_t Length);
+
+        /** @brief          Decode a remaining length or a variable byte integer.
+         *  @param Reader   Packet reader
+         *  @param Offset   Offset of the first byte of the integer
+         *  @param Length   Pointer to decoded value
+         *  @param Bytes    Pointer to number of bytes used by the integer
+         *  @return         Error code. #INCOMPLETE when the integer isn´t complete
+         */
+        static MQTTCodec::Error DecodeLength(const MQTTCodec::Reader& Reader, uint16_t Offset, uint32_t* Length, uint8_t* Bytes);
+
+        /** @brief                  Encode the fixed header in front of the message in a packet buffer.
+         *  @param Buffer           Pointer to packet buffer. The message starts at offset #MQTT_FIXED_HEADER_SIZE
+         *  @param Type             Type of the control packet
+         *  @param Flags            Flags of the control packet
+         *  @param RemainingLength  Length of the complete message without the fixed header
+         *  @return                 Offset of the first byte of the fixed header in the packet buffer
+         */
+        static uint16_t EncodeFixedHeader(uint8_t* Buffer, uint8_t Type, uint8_t Flags, uint32_t RemainingLength);
+
+        /** @brief          Copy an UTF-8 string with its length into a buffer.
+         *  @param Buffer   Pointer to buffer
+         *  @param Size     Size of the buffer
+         *  @param Offset   Pointer to byte offset in the buffer
+         *  @param String   UTF-8 string
+         *  @return         Error code
+         */
+        static MQTTCodec::Error EncodeString(uint8_t* Buffer, uint16_t Size, uint16_t* Offset, const char* String);
+
+        /** @brief          Encode a CONNECT packet.
+         *  @param Buffer   Pointer to packet buffer
+         *  @param Size     Size of the packet buffer
+         *  @param Version  MQTT protocol version
+         *  @param Options  Content of the packet
+         *  @param Start    Pointer to offset of the packet in the buffer
+         *  @param Length   Pointer to length of the packet
+         *  @return         Error code
+         */
+        static MQTTCodec::Error EncodeConnect(uint8_t* Buffer, uint16_t Size, uint8_t Version, const MQTTCodec::ConnectOptions& Options, uint16_t* Start, uint16_t* Length);
+
+        /** @brief                  Encode the fixed header, the topic, the message ID and the properties of a PUBLISH packet.
+         *                          NOTE: The payload isn´t copied. Transmit it directly after the header!
+         *  @param Buffer           Pointer to packet buffer
+         *  @param Size             Size of the packet buffer
+         *  @param Version          MQTT protocol version
+         *  @param Options          Content of the header
+         *  @param PayloadLength    Length of the payload
+         *  @param Start            Pointer to offset of the header in the buffer
+         *  @param Length           Pointer to length of the header
+         *  @return                 Error code
+         */
+        static MQTTCodec::Error EncodePublish(uint8_t* Buffer, uint16_t Size, uint8_t Version, const MQTTCodec::PublishOptions& Options, uint32_t PayloadLength, uint16_t* Start, uint16_t* Length);
+
+        /** @brief          Encode the properties of a MQTT 5 PUBLISH packet.
+         *  @param Buffer   Pointer to buffer with space for 4 bytes
+         *  @param Alias    Topic alias. 0 when the message doesn´t use an alias
+         *  @return         Number of bytes written
+         */
+        static uint8_t EncodePublishProperties(uint8_t* Buffer, uint16_t Alias);
+
+        /** @brief          Encode a SUBSCRIBE packet with one or more topic filters.
+         *  @param Buffer   Pointer to packet buffer
+         *  @param Size     Size of the packet buffer
+         *  @param Version  MQTT protocol version
+         *  @param ID       Message ID
+         *  @param Filters  Array with topic filters
+         *  @param Count    Number of topic filters
+         *  @param Start    Pointer to offset of the packet in the buffer
+         *  @param Length   Pointer to length of the packet
+         *  @return         Error code
+         */
+        static MQTTCodec::Error EncodeSubscribe(uint8_t* Buffer, uint16_t Size, uint8_t Version, uint16_t ID, const MQTTCodec::TopicFilter* Filters, uint8_t Count, uint16_t* Start, uint16_t* Length);
+
+        /** @brief          Encode an UNSUBSCRIBE packet with one or more topic filters.
+         *  @param Buffer   Pointer to packet buffer
+         *  @param Size     Size of the packet buffer
+         *  @param Version  MQTT protocol version
+         *  @param ID       Message ID
+         *  @param Topics   Array with topic filters
+         *  @param Count    Number of topic filters
+         *  @param Start    Pointer to offset of the packet in the buffer
+         *  @param Length   Pointer to length of the packet
+         *  @return         Error code
+         */
+        static MQTTCodec::Error EncodeUnsubscribe(uint8_t* Buffer, uint16_t Size, uint8_t Version, uint16_t ID, const char* const* Topics, uint8_t Count, uint16_t* Start, uint16_t* Length);
+
+        /** @brief          Encode a PUBACK, PUBREC, PUBREL or PUBCOMP packet.
+         *  @param Buffer   Pointer to buffer with space for 4 bytes
+         *  @param Type     Type of the acknowledge
+         *  @param ID       Message ID
+         *  @return         Length of the packet
+         */
+        static uint8_t EncodeAck(uint8_t* Buffer, uint8_t Type, uint16_t ID);
+
+        /** @brief          Decode the fixed header of a packet.
+         *  @param Reader   Packet reader
+         *  @param Header   Pointer to decoded header
+         *  @return         Error code. #INCOMPLETE when the fixed header isn´t complete
+         */
+        static MQTTCodec::Error DecodeFixedHeader(const MQTTCodec::Reader& Reader, MQTTCodec::FixedHeader* Header);
+
+        /** @brief              Decode a complete CONNACK packet.
+         *  @param Reader       Packet reader
+         *  @param Version      MQTT protocol version
+         *  @param HeaderSize   Size of the fixed header
+         *  @param Connack      Pointer to decoded packet
+         *  @return             Error code
+         */
+        static MQTTCodec::Error DecodeConnack(const MQTTCodec::Reader& Reader, uint8_t Version, uint8_t HeaderSize, MQTTCodec::Connack* Connack);
+
+        /** @brief              Decode a complete PUBLISH packet. The MQTT 5 properties are skipped.
+         *  @param Reader       Packet reader
+         *  @param Version      MQTT protocol version
+         *  @param HeaderSize   Size of the fixed header
+         *  @param Publish      Pointer to decoded packet
+         *  @return             Error code
+         */
+        static MQTTCodec::Error DecodePublish(const MQTTCodec::Reader& Reader, uint8_t Version, uint8_t HeaderSize, MQTTCodec::PublishInfo* Publish);
+
+        /** @brief              Decode a complete PUBACK, PUBREC, PUBREL or PUBCOMP packet.
+         *  @param Reader       Packet reader
+         *  @param Version      MQTT protocol version
+         *  @param HeaderSize   Size of the fixed header
+         *  @param Ack          Pointer to decoded packet
+         *  @return             Error code
+         */
+        static MQTTCodec::Error DecodeAck(const MQTTCodec::Reader& Reader, uint8_t Version, uint8_t HeaderSize, MQTTCodec::Ack* Ack);
+
+        /** @brief              Decode a complete SUBACK or UNSUBACK packet. The MQTT 5 properties are skipped.
+         *                      NOTE: A MQTT 3.1.1 UNSUBACK doesn´t contain return codes!
+         *  @param Reader       Packet reader
+         *  @param Version      MQTT protocol version
+         *  @param HeaderSize   Size of the fixed header
+         *  @param ID           Pointer to message ID
+         *  @param Codes        Pointer to buffer for the return codes (one for each topic filter of the request)
+         *  @param Size         Size of the buffer
+         *  @param Count        Pointer to number of return codes in the buffer
+         *  @return             Error code. #BUFFER_OVERFLOW when the packet contains more than Size return codes
+         */
+        static MQTTCodec::Error DecodeSubscribeAck(const MQTTCodec::Reader& Reader, uint8_t Version, uint8_t HeaderSize, uint16_t* ID, uint8_t* Codes, uint8_t Size, uint8_t* Count);
+
+    private:
+        static uint8_t _peek(const MQTTCodec::Reader& Reader, uint16_t Offset);
+        static uint16_t _peekInteger(const MQTTCodec::Reader& Reader, uint16_t Offset);
+
+        /** @brief          Get the size of the value of a MQTT 5 property.
+         *  @param Reader   Packet reader
+         *  @param Property Property identifier
+         *  @param Offset   Offset of the property value
+         *  @return         Size of the value in bytes. 0 for unknown properties
+         */
+        static uint16_t _propertySize(const MQTTCodec::Reader& Reader, uint8_t Property, uint16_t Offset);
+};
@@ -0,0 +1,296 @@
+/*
+ * MQTTDispatcher.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Topic filter dispatcher for received MQTT messages.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTTDispatcher.cpp
+ *  @brief Topic filter dispatcher for received MQTT messages.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include "MQTTDispatcher.h"
+
+MQTTDispatcher::MQTTDispatcher(void)
+{
+    this->Clear();
+}
+
+MQTTDispatcher::Error MQTTDispatcher::Register(const char* Filter, MQTT::Publish_Callback Handler)
+{
+    uint8_t Index;
+
+    if(Handler == NULL)
+    {
+        return INVALID_FILTER;
+    }
+
+    MQTTDispatcher::Error Error = this->_findFilter(Filter, true, &Index);
+    if(Error)
+    {
+        return Error;
+    }
+
+    this->_mNodes[Index].Handler = Handler;
+
+    return NO_ERROR;
+}
+
+MQTTDispatcher::Error MQTTDispatcher::Unregister(const char* Filter)
+{
+    uint8_t Index;
+
+    MQTTDispatcher::Error Error = this->_findFilter(Filter, false, &Index);
+    if(Error)
+    {
+        return Error;
+    }
+
+    if(this->_mNodes[Index].Handler == NULL)
+    {
+        return NOT_FOUND;
+    }
+
+    this->_mNodes[Index].Handler = NULL;
+
+    return NO_ERROR;
+}
+
+void MQTTDispatcher::Clear(void)
+{
+    // Node 0 is the root node. It doesn´t represent a topic level
+    this->_mNodes[0].Level = NULL;
+    this->_mNodes[0].Length = 0x00;
+    this->_mNodes[0].Child = 0x00;
+    this->_mNodes[0].Next = 0x00;
+    this->_mNodes[0].Handler = NULL;
+    this->_mNodeCount = 0x01;
+}
+
+uint8_t MQTTDispatcher::Dispatch(const MQTT::View* Topic, const MQTT::View* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP)
+{
+    uint8_t Active[MQTT_DISPATCHER_MAX_ACTIVE];
+    uint8_t Matches[MQTT_DISPATCHER_MAX_ACTIVE];
+    uint8_t ActiveCount = 0x01;
+    uint8_t Called = 0x00;
+    uint16_t Start = 0x00;
+    uint16_t TopicLength;
+    bool System;
+
+    if(Topic == NULL)
+    {
+        return 0x00;
+    }
+
+    TopicLength = Topic->FirstLength + Topic->SecondLength;
+
+    // Topics starting with '$' are not matched by a wildcard in the first level
+    System = (TopicLength > 0x00) && (MQTTDispatcher::_charAt(Topic, 0x00) == '$');
+
+    // Start with the root node
+    Active[0] = 0x00;
+
+    while(ActiveCount > 0x00)
+    {
+        uint16_t End = Start;
+        uint8_t MatchCount = 0x00;
+
+        // Get the end of the current topic level
+        while((End < TopicLength) && (MQTTDispatcher::_charAt(Topic, End) != '/'))
+        {
+            End++;
+        }
+
+        for(uint8_t i = 0x00; i < ActiveCount; i++)
+        {
+            for(uint8_t Child = this->_mNodes[Active[i]].Child; Child != 0x00; Child = this->_mNodes[Child].Next)
+            {
+                const Node* Current = &this->_mNodes[Child];
+
+                // The multi level wildcard matches the current level and all following levels
+                if(MQTTDispatcher::_isWildcard(Current, '#'))
+                {
+                    if((Current->Handler != NULL) && !(System && (Start == 0x00)))
+                    {
+                        Current->Handler(Topic, Payload, ID, QoS, DUP);
+                        Called++;
+                    }
+                }
+                else if((MQTTDispatcher::_isWildcard(Current, '+') && !(System && (Start == 0x00))) ||
+                         MQTTDispatcher::_compareLevel(Current, Topic, Start, End - Start))
+                {
+                    // NOTE: Additional matches are dropped when more nodes are matching than #MQTT_DISPATCHER_MAX_ACTIVE!
+                    if(MatchCount < MQTT_DISPATCHER_MAX_ACTIVE)
+                    {
+                        Matches[MatchCount++] = Child;
+                    }
+                }
+            }
+        }
+
+        // Last topic level reached. Call the handlers of the matching filters
+        if(End >= TopicLength)
+        {
+            for(uint8_t i = 0x00; i < MatchCount; i++)
+            {
+                const Node* Current = &this->_mNodes[Matches[i]];
+
+                if(Current->Handler != NULL)
+                {
+                    Current->Handler(Topic, Payload, ID, QoS, DUP);
+                    Called++;
+                }
+
+                // A multi level wildcard also matches the parent level (i. e. "sensorhub/#" matches "sensorhub")
+                for(uint8_t Child = Current->Child; Child != 0x00; Child = this->_mNodes[Child].Next)
+                {
+                    if(MQTTDispatcher::_isWildcard(&this->_mNodes[Child], '#') && (this->_mNodes[Child].Handler != NULL))
+                    {
+                        this->_mNodes[Child].Handler(Topic, Payload, ID, QoS, DUP);
+                        Called++;
+                    }
+                }
+            }
+
+            break;
+        }
+
+        memcpy(Active, Matches, MatchCount);
+        ActiveCount = MatchCount;
+        Start = End + 0x01;
+    }
+
+    return Called;
+}
+
+MQTTDispatcher::Error MQTTDispatcher::_findFilter(const char* Filter, bool Create, uint8_t* Index)
+{
+    uint8_t Parent = 0x00;
+
+    if((Filter == NULL) || (*Filter == '\0'))
+    {
+        return INVALID_FILTER;
+    }
+
+    while(true)
+    {
+        uint8_t Child;
+        const char* End = Filter;
+
+        // Get the end of the current topic level
+        while((*End != '/') && (*End != '\0'))
+        {
+            End++;
+        }
+
+        // Wildcards must occupy the whole level and the multi level wildcard must be the last level
+        for(const char* Character = Filter; Character < End; Character++)
+        {
+            if(((*Character == '+') || (*Character == '#')) && ((End - Filter) != 0x01))
+            {
+                return INVALID_FILTER;
+            }
+        }
+
+        if((*Filter == '#') && (*End != '\0'))
+        {
+            return INVALID_FILTER;
+        }
+
+        // Search the level in the children of the parent node
+        for(Child = this->_mNodes[Parent].Child; Child != 0x00; Child = this->_mNodes[Child].Next)
+        {
+            const Node* Current = &this->_mNodes[Child];
+
+            if((Current->Length == (End - Filter)) && !strncmp(Current->Level, Filter, Current->Length))
+            {
+                break;
+            }
+        }
+
+        if(Child == 0x00)
+        {
+            if(!Create)
+            {
+                return NOT_FOUND;
+            }
+
+            if(this->_mNodeCount >= MQTT_DISPATCHER_MAX_NODES)
+            {
+                return NO_MEMORY;
+            }
+
+            Child = this->_mNodeCount++;
+            this->_mNodes[Child].Level = Filter;
+            this->_mNodes[Child].Length = End - Filter;
+            this->_mNodes[Child].Child = 0x00;
+            this->_mNodes[Child].Handler = NULL;
+
+            // Insert the new node as first child of the parent node
+            this->_mNodes[Child].Next = this->_mNodes[Parent].Child;
+            this->_mNodes[Parent].Child = Child;
+        }
+
+        if(*End == '\0')
+        {
+            *Index = Child;
+
+            return NO_ERROR;
+        }
+
+        Parent = Child;
+        Filter = End + 0x01;
+    }
+}
+
+char MQTTDispatcher::_charAt(const MQTT::View* View, uint16_t Index)
+{
+    if(Index < View->FirstLength)
+    {
+        return View->First[Index];
+    }
+
+    return View->Second[Index - View->FirstLength];
+}
+
+bool MQTTDispatcher::_compareLevel(const MQTTDispatcher::Node* Node, const MQTT::View* View, uint16_t Start, uint16_t Length)
+{
+    if(Node->Length != Length)
+    {
+        return false;
+    }
+
+    for(uint16_t i = 0x00; i < Length; i++)
+    {
+        if(Node->Level[i] != MQTTDispatcher::_charAt(View, Start + i))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool MQTTDispatcher::_isWildcard(const MQTTDispatcher::Node* Node, char Wildcard)
+{
+    return (Node->Length == 0x01) && (Node->Level[0] == Wildcard);
+}
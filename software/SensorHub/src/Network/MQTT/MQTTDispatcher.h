@@ -0,0 +1,140 @@
+/*
+ * MQTTDispatcher.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Topic filter dispatcher for received MQTT messages.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+#pragma once
+
+/** @file MQTT/MQTTDispatcher.h
+ *  @brief Topic filter dispatcher for received MQTT messages.
+ *         The topic filters are stored in a static trie with one node per topic level.
+ *         A received topic is matched in a single pass over the topic without any allocation.
+ *         The filters support the single level (+) and the multi level (#) wildcard.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include "MQTT.h"
+
+class MQTTDispatcher
+{
+    public:
+        /** @brief Maximum number of trie nodes (one node per unique topic level, including the root node).
+         */
+        #define MQTT_DISPATCHER_MAX_NODES               32
+
+        /** @brief Maximum number of trie nodes which can match the same topic level at the same time.
+         */
+        #define MQTT_DISPATCHER_MAX_ACTIVE              8
+
+        /** @brief Dispatcher error codes.
+         */
+        typedef enum
+        {
+            NO_ERROR = 0x00,						            /**< No error. */
+            INVALID_FILTER = 0x01,						        /**< Invalid topic filter. */
+            NO_MEMORY = 0x02,						            /**< Not enough trie nodes available. Increase #MQTT_DISPATCHER_MAX_NODES. */
+            NOT_FOUND = 0x03,						            /**< Topic filter not registered. */
+        } Error;
+
+        /** @brief Constructor.
+         */
+        MQTTDispatcher(void);
+
+        /** @brief          Register a handler for a topic filter. An existing handler for the same filter is replaced.
+         *  @param Filter   Topic filter (i. e. "sensorhub/+/config" or "sensorhub/#")
+         *                  NOTE: The filter is not copied and must be valid as long as the handler is registered!
+         *  @param Handler  Handler for messages which match the filter
+         *  @return         Error code
+         */
+        MQTTDispatcher::Error Register(const char* Filter, MQTT::Publish_Callback Handler);
+
+        /** @brief          Remove the handler of a topic filter.
+         *                  NOTE: The trie nodes are not released!
+         *  @param Filter   Topic filter
+         *  @return         Error code
+         */
+        MQTTDispatcher::Error Unregister(const char* Filter);
+
+        /** @brief Remove all topic filters.
+         */
+        void Clear(void);
+
+        /** @brief          Call the handlers of all topic filters which match the topic of a received message.
+         *                  Use this function as or inside of the publish received callback of the MQTT client.
+         *  @param Topic    Pointer to view of the topic string
+         *  @param Payload  Pointer to view of the payload
+         *  @param ID       Message ID
+         *  @param QoS      Quality of service of the received message
+         *  @param DUP      Received DUP flag
+         *  @return         Number of called handlers
+         */
+        uint8_t Dispatch(const MQTT::View* Topic, const MQTT::View* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP);
+
+    private:
+        /** @brief Trie node for a single topic level.
+         */
+        typedef struct
+        {
+            const char* Level;							        /**< Pointer to the topic level in the filter string. */
+            uint16_t Length;							        /**< Length of the topic level. */
+            uint8_t Child;							            /**< Index of the first child node. 0 if the node doesn´t have children. */
+            uint8_t Next;							            /**< Index of the next sibling node. 0 if the node is the last sibling. */
+            MQTT::Publish_Callback Handler;					    /**< Handler of the topic filter which ends with this node. NULL if no filter ends here. */
+        } Node;
+
+        static_assert(MQTT_DISPATCHER_MAX_NODES <= 256, "MQTT_DISPATCHER_MAX_NODES must fit into 8 bits!");
+
+        Node _mNodes[MQTT_DISPATCHER_MAX_NODES];
+        uint8_t _mNodeCount;
+
+        /** @brief          Find the node for a topic filter.
+         *  @param Filter   Topic filter
+         *  @param Create   #true when missing nodes should be created
+         *  @param Index    Pointer to node index
+         *  @return         Error code
+         */
+        MQTTDispatcher::Error _findFilter(const char* Filter, bool Create, uint8_t* Index);
+
+        /** @brief          Get a single character from a view.
+         *  @param View     Pointer to view
+         *  @param Index    Character index
+         *  @return         Character
+         */
+        static char _charAt(const MQTT::View* View, uint16_t Index);
+
+        /** @brief          Compare the topic level of a node with a topic level from a view.
+         *  @param Node     Pointer to trie node
+         *  @param View     Pointer to view of the topic string
+         *  @param Start    Offset of the topic level in the view
+         *  @param Length   Length of the topic level
+         *  @return         #true when both levels are equal
+         */
+        static bool _compareLevel(const MQTTDispatcher::Node* Node, const MQTT::View* View, uint16_t Start, uint16_t Length);
+
+        /** @brief          Test if a node is a wildcard node.
+         *  @param Node     Pointer to trie node
+         *  @param Wildcard Wildcard character
+         *  @return         #true when the node is the wildcard
+         */
+        static bool _isWildcard(const MQTTDispatcher::Node* Node, char Wildcard);
+};
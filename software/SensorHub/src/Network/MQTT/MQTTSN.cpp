@@ -0,0 +1,190 @@
+/*
+ * MQTTSN.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: MQTT-SN client for Particle IoT devices.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTTSN.cpp
+ *  @brief MQTT-SN 1.2 client for the Particle IoT Argon.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include "MQTTSN.h"
+
+MQTTSN::MQTTSN(void) : MQTTSN(IPAddress(0, 0, 0, 0), MQTTSN_DEFAULT_PORT)
+{
+}
+
+MQTTSN::MQTTSN(IPAddress IP) : MQTTSN(IP, MQTTSN_DEFAULT_PORT)
+{
+}
+
+MQTTSN::MQTTSN(IPAddress IP, uint16_t Port)
+{
+    this->_mIP = IP;
+    this->_mPort = Port;
+    this->_mStarted = false;
+}
+
+MQTTSN::~MQTTSN(void)
+{
+    this->End();
+}
+
+MQTTSN::Error MQTTSN::Begin(void)
+{
+    if(!this->_mStarted)
+    {
+        if(!this->_mUDP.begin(MQTTSN_LOCAL_PORT))
+        {
+            return TRANSMISSION_ERROR;
+        }
+
+        this->_mStarted = true;
+    }
+
+    return NO_ERROR;
+}
+
+void MQTTSN::End(void)
+{
+    if(this->_mStarted)
+    {
+        this->_mUDP.stop();
+        this->_mStarted = false;
+    }
+}
+
+void MQTTSN::SetGateway(IPAddress IP)
+{
+    this->_mIP = IP;
+}
+
+void MQTTSN::SetGateway(IPAddress IP, uint16_t Port)
+{
+    this->_mIP = IP;
+    this->_mPort = Port;
+}
+
+MQTTSN::Topic MQTTSN::PredefinedTopic(uint16_t ID)
+{
+    MQTTSN::Topic Topic;
+
+    Topic.ID = ID;
+    Topic.Type = TOPIC_PREDEFINED;
+
+    return Topic;
+}
+
+MQTTSN::Error MQTTSN::ShortTopic(const char* Name, MQTTSN::Topic* Topic)
+{
+    if((Name == NULL) || (Topic == NULL) || (strlen(Name) != 0x02))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    // The two characters of the name are transmitted instead of the topic ID
+    Topic->ID = ((uint8_t)Name[0] << 0x08) | (uint8_t)Name[1];
+    Topic->Type = TOPIC_SHORT;
+
+    return NO_ERROR;
+}
+
+MQTTSN::Error MQTTSN::Publish(const MQTTSN::Topic& Topic, const char* Payload, uint16_t Length)
+{
+    return this->Publish(Topic, (const uint8_t*)Payload, Length, false);
+}
+
+MQTTSN::Error MQTTSN::Publish(const MQTTSN::Topic& Topic, const uint8_t* Payload, uint16_t Length)
+{
+    return this->Publish(Topic, Payload, Length, false);
+}
+
+MQTTSN::Error MQTTSN::Publish(const MQTTSN::Topic& Topic, const uint8_t* Payload, uint16_t Length, bool Retain)
+{
+    const MQTT::Segment Segment = {Payload, Length};
+
+    if((Payload == NULL) && Length)
+    {
+        return INVALID_PARAMETER;
+    }
+
+    return this->Publish(Topic, &Segment, 0x01, Retain);
+}
+
+MQTTSN::Error MQTTSN::Publish(const MQTTSN::Topic& Topic, const MQTT::Segment* Segments, uint8_t Count, bool Retain)
+{
+    uint8_t Header[MQTTSN_PUBLISH_HEADER_SIZE];
+    uint8_t HeaderLength;
+    uint32_t Length = 0x00;
+
+    if(((Segments == NULL) && Count) || (Topic.Type == TOPIC_NORMAL))
+    {
+        return INVALID_PARAMETER;
+    }
+
+    if(!this->_mStarted)
+    {
+        return NOT_STARTED;
+    }
+
+    for(uint8_t i = 0x00; i < Count; i++)
+    {
+        if((Segments[i].Data == NULL) && Segments[i].Length)
+        {
+            return INVALID_PARAMETER;
+        }
+
+        Length += Segments[i].Length;
+    }
+
+    if(MQTTSNCodec::EncodePublish(Header, Topic.Type, Topic.ID, Retain, Length, &HeaderLength))
+    {
+        return BUFFER_OVERFLOW;
+    }
+
+    // Collect the header and the payload segments in a single datagram
+    if(this->_mUDP.beginPacket(this->_mIP, this->_mPort) <= 0x00)
+    {
+        return TRANSMISSION_ERROR;
+    }
+
+    if(this->_mUDP.write(Header, HeaderLength) != HeaderLength)
+    {
+        return TRANSMISSION_ERROR;
+    }
+
+    for(uint8_t i = 0x00; i < Count; i++)
+    {
+        if(this->_mUDP.write(Segments[i].Data, Segments[i].Length) != Segments[i].Length)
+        {
+            return TRANSMISSION_ERROR;
+        }
+    }
+
+    if(this->_mUDP.endPacket() < 0x00)
+    {
+        return TRANSMISSION_ERROR;
+    }
+
+    return NO_ERROR;
+}
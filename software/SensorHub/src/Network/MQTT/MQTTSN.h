@@ -0,0 +1,177 @@
+/*
+ * MQTTSN.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: MQTT-SN client for Particle IoT devices.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+#pragma once
+
+/** @file MQTT/MQTTSN.h
+ *  @brief MQTT-SN 1.2 client for the Particle IoT Argon.
+ *		   Please read
+ *			- https://www.oasis-open.org/committees/download.php/66091/MQTT-SN_spec_v1.2.pdf
+ *		   when you need more information.
+ *
+ *         The client only supports QoS -1 messages. QoS -1 messages are transmitted as single UDP
+ *         datagrams to the gateway without a connection, so the device doesn´t need a TCP handshake
+ *         or a CONNECT before the first message. The topics must be known by the gateway, so only
+ *         predefined topic IDs and short topic names are supported.
+ *
+ *         The messages are encoded with #MQTTSNCodec from MQTT/MQTTSNCodec.h.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include "MQTT.h"
+#include "MQTTSNCodec.h"
+
+class MQTTSN
+{
+    public:
+        /** @brief Default port of the MQTT-SN gateway.
+         */
+        #define MQTTSN_DEFAULT_PORT                     1884
+
+        /** @brief Local UDP port used by the client.
+         */
+        #define MQTTSN_LOCAL_PORT                       1884
+
+        /** @brief MQTT-SN error codes.
+         */
+        typedef enum
+        {
+            NO_ERROR = 0x00,							        /**< No error. */
+            NOT_STARTED = 0x01,							        /**< The UDP socket is not open. Use #Begin first. */
+            INVALID_PARAMETER = 0x02,							/**< Invalid function parameter. */
+            TRANSMISSION_ERROR = 0x03,							/**< General transmission error. */
+            BUFFER_OVERFLOW = 0x04,							    /**< The message exceeds #MQTTSN_MAX_PACKET_SIZE. */
+        } Error;
+
+        /** @brief MQTT-SN topic ID types.
+         */
+        typedef enum
+        {
+            TOPIC_NORMAL = 0x00,							    /**< Topic ID registered with a REGISTER message. Not supported by this client. */
+            TOPIC_PREDEFINED = 0x01,							/**< Topic ID configured in the gateway and the client. */
+            TOPIC_SHORT = 0x02,							        /**< Topic name with two characters. */
+        } TopicType;
+
+        /** @brief MQTT-SN topic object. Use #PredefinedTopic or #ShortTopic to create the object.
+         */
+        typedef struct
+        {
+            uint16_t ID;							            /**< Topic ID or the two characters of a short topic name. */
+            MQTTSN::TopicType Type;							    /**< Type of the topic ID. */
+        } Topic;
+
+        /** @brief Constructor.
+         */
+        MQTTSN(void);
+
+        /** @brief      Constructor.
+         *  @param IP   IP address of the MQTT-SN gateway
+         */
+        MQTTSN(IPAddress IP);
+
+        /** @brief      Constructor.
+         *  @param IP   IP address of the MQTT-SN gateway
+         *  @param Port Port of the MQTT-SN gateway
+         */
+        MQTTSN(IPAddress IP, uint16_t Port);
+
+        /** @brief Deconstructor.
+         */
+        ~MQTTSN(void);
+
+        /** @brief  Open the UDP socket of the client.
+         *          NOTE: The network has to be ready!
+         *  @return Error code
+         */
+        MQTTSN::Error Begin(void);
+
+        /** @brief Close the UDP socket of the client.
+         */
+        void End(void);
+
+        /** @brief      Set the address of the MQTT-SN gateway.
+         *  @param IP   IP address of the gateway
+         */
+        void SetGateway(IPAddress IP);
+
+        /** @brief      Set the address of the MQTT-SN gateway.
+         *  @param IP   IP address of the gateway
+         *  @param Port Port of the gateway
+         */
+        void SetGateway(IPAddress IP, uint16_t Port);
+
+        /** @brief      Create a topic object for a predefined topic ID.
+         *  @param ID   Topic ID configured in the gateway
+         *  @return     Topic object
+         */
+        static MQTTSN::Topic PredefinedTopic(uint16_t ID);
+
+        /** @brief          Create a topic object for a short topic name.
+         *  @param Name     Topic name with exactly two characters
+         *  @param Topic    Pointer to topic object
+         *  @return         Error code
+         */
+        static MQTTSN::Error ShortTopic(const char* Name, MQTTSN::Topic* Topic);
+
+        /** @brief          Publish a QoS -1 message.
+         *  @param Topic    Topic object
+         *  @param Payload  Message payload
+         *  @param Length   Payload length
+         *  @return         Error code
+         */
+        MQTTSN::Error Publish(const MQTTSN::Topic& Topic, const char* Payload, uint16_t Length);
+
+        /** @brief          Publish a QoS -1 message.
+         *  @param Topic    Topic object
+         *  @param Payload  Message payload
+         *  @param Length   Payload length
+         *  @return         Error code
+         */
+        MQTTSN::Error Publish(const MQTTSN::Topic& Topic, const uint8_t* Payload, uint16_t Length);
+
+        /** @brief          Publish a QoS -1 message.
+         *  @param Topic    Topic object
+         *  @param Payload  Message payload
+         *  @param Length   Payload length
+         *  @param Retain   Retain flag for the gateway
+         *  @return         Error code
+         */
+        MQTTSN::Error Publish(const MQTTSN::Topic& Topic, const uint8_t* Payload, uint16_t Length, bool Retain);
+
+        /** @brief          Publish a QoS -1 message with a payload from multiple segments.
+         *  @param Topic    Topic object
+         *  @param Segments Array with payload segments
+         *  @param Count    Number of payload segments
+         *  @param Retain   Retain flag for the gateway
+         *  @return         Error code
+         */
+        MQTTSN::Error Publish(const MQTTSN::Topic& Topic, const MQTT::Segment* Segments, uint8_t Count, bool Retain);
+
+    private:
+        UDP _mUDP;
+        IPAddress _mIP;
+        uint16_t _mPort;
+        bool _mStarted;
+};
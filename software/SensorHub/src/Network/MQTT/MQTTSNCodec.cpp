@@ -0,0 +1,68 @@
+/*
+ * MQTTSNCodec.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Transport independent encoder for MQTT-SN messages.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file MQTT/MQTTSNCodec.cpp
+ *  @brief Encoder for MQTT-SN messages.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include "MQTTSNCodec.h"
+
+MQTTSNCodec::Error MQTTSNCodec::EncodePublish(uint8_t* Buffer, uint8_t TopicType, uint16_t TopicID, bool Retain, uint32_t PayloadLength, uint8_t* Length)
+{
+    uint8_t HeaderLength = 0x00;
+
+    // The length field uses one byte for messages up to 255 bytes and three bytes for larger messages.
+    // The length includes the length field, the message type, the flags, the topic ID and the message ID
+    uint32_t MessageLength = PayloadLength + 0x07;
+    if(MessageLength > 0xFF)
+    {
+        MessageLength += 0x02;
+        if(MessageLength > MQTTSN_MAX_PACKET_SIZE)
+        {
+            return BUFFER_OVERFLOW;
+        }
+
+        Buffer[HeaderLength++] = 0x01;
+        Buffer[HeaderLength++] = (MessageLength >> 0x08);
+        Buffer[HeaderLength++] = (MessageLength & 0xFF);
+    }
+    else
+    {
+        Buffer[HeaderLength++] = MessageLength;
+    }
+
+    // QoS -1 is encoded with both QoS bits set. The message ID isn´t used and has to be zero
+    Buffer[HeaderLength++] = PUBLISH;
+    Buffer[HeaderLength++] = (0x03 << 0x05) | (((uint8_t)Retain) << 0x04) | (TopicType & 0x03);
+    Buffer[HeaderLength++] = (TopicID >> 0x08);
+    Buffer[HeaderLength++] = (TopicID & 0xFF);
+    Buffer[HeaderLength++] = 0x00;
+    Buffer[HeaderLength++] = 0x00;
+
+    *Length = HeaderLength;
+
+    return NO_ERROR;
+}
@@ -0,0 +1,74 @@
+/*
+ * MQTTSNCodec.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Transport independent encoder for MQTT-SN messages.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+#pragma once
+
+/** @file MQTT/MQTTSNCodec.h
+ *  @brief Encoder for MQTT-SN 1.2 messages. Like #MQTTCodec the encoder only works on memory buffers and
+ *         doesn´t use the Device OS, so it can be compiled and tested on a host computer.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+class MQTTSNCodec
+{
+    public:
+        /** @brief Maximum size of a MQTT-SN datagram. Larger messages are rejected.
+         *         NOTE: The UDP stack of the Device OS buffers up to 512 bytes per packet!
+         */
+        #define MQTTSN_MAX_PACKET_SIZE                  512
+
+        /** @brief Maximum size of the header of a PUBLISH message (three byte length field).
+         */
+        #define MQTTSN_PUBLISH_HEADER_SIZE              9
+
+        /** @brief Codec error codes.
+         */
+        typedef enum
+        {
+            NO_ERROR = 0x00,							        /**< No error. */
+            BUFFER_OVERFLOW = 0x01,							    /**< The message exceeds #MQTTSN_MAX_PACKET_SIZE. */
+        } Error;
+
+        /** @brief MQTT-SN message types.
+         */
+        typedef enum
+        {
+            PUBLISH = 0x0C,
+        } MessageType;
+
+        /** @brief                  Encode the header of a QoS -1 PUBLISH message. The payload follows directly after the header.
+         *  @param Buffer           Pointer to buffer with space for #MQTTSN_PUBLISH_HEADER_SIZE bytes
+         *  @param TopicType        Type of the topic ID (predefined or short topic name)
+         *  @param TopicID          Topic ID or the two characters of a short topic name
+         *  @param Retain           Retain flag for the gateway
+         *  @param PayloadLength    Length of the payload
+         *  @param Length           Pointer to header length
+         *  @return                 Error code
+         */
+        static MQTTSNCodec::Error EncodePublish(uint8_t* Buffer, uint8_t TopicType, uint16_t TopicID, bool Retain, uint32_t PayloadLength, uint8_t* Length);
+};
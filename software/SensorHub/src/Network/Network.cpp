@@ -26,6 +26,15 @@
 
 #define NETWORK_IP_LOC                  0x00
 
+// Publish the statistics of the MQTT client with every n-th message
+#define NETWORK_DIAGNOSTICS_INTERVAL    24
+
+// Size of the diagnostics message buffer. The message has about 980 bytes when all counters have their maximum value
+#define NETWORK_DIAGNOSTICS_SIZE        1024
+
+// Maximum number of connection attempts per wake up
+#define NETWORK_RETRY_BUDGET            3
+
 // Bluetooth service UUID
 static const char* ServiceUUID = "b4250401-fb4b-4746-b2b0-93f0e61122c6";
 static const char* ServerUUID = "b4250402-fb4b-4746-b2b0-93f0e61122c6";
@@ -33,7 +42,20 @@ static const char* ServerUUID = "b4250402-fb4b-4746-b2b0-93f0e61122c6";
 BleCharacteristic Network::_mServerIPCharacteristic("Server address", BleCharacteristicProperty::WRITE_WO_RSP, ServerUUID, BleUuid(ServiceUUID), &Network::_bluetoothDataReceived, (void*)ServerUUID);
 BleAdvertisingData Network::_mBluetoothAdvertise;
 
-MQTT Network::_mClient;
+Network::Client Network::_mClient;
+MQTTSN Network::_mDatagramClient;
+
+// Topic names for #Network::Topic
+static const char* Topics[] = {"sensorhub/weather", "sensorhub/errors", "sensorhub/diagnostics", "sensorhub/weather/frame", "sensorhub/weather/cbor", "sensorhub/weather/batch"};
+
+MQTT::PreparedPublish Network::_mTopics[sizeof(Topics) / sizeof(Topics[0])];
+
+// Names of the MQTT control packets for the diagnostics message. The packet type is used as index
+static const char* PacketNames[] = {NULL, "CONNECT", "CONNACK", "PUBLISH", "PUBACK", "PUBREC", "PUBREL", "PUBCOMP", "SUBSCRIBE", "SUBACK", "UNSUBSCRIBE", "UNSUBACK", "PINGREQ", "PINGRESP", "DISCONNECT", "AUTH"};
+
+uint16_t Network::_mCycles;
+char Network::_mDiagnostics[NETWORK_DIAGNOSTICS_SIZE];
+MQTTDispatcher Network::_mDispatcher;
 IPAddress Network::_mServerAddress;
 
 Network::Error Network::_mLastError;
@@ -43,20 +65,21 @@ Network::Error Network::lastError(void)
     return Network::_mLastError;
 }
 
-void Network::_callback(uint16_t TopicLength, char* Topic, uint16_t PayloadLength, char* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP)
+void Network::_callback(const MQTT::View* Topic, const MQTT::View* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP)
 {
-    Serial.printlnf("Topic lenght: %i", TopicLength);
-    for(uint8_t i = 0x00; i < TopicLength; i++)
+    // Route the message to the registered handlers
+    if(Network::_mDispatcher.Dispatch(Topic, Payload, ID, QoS, DUP))
     {
-        Serial.print(Topic[i]);
+        return;
     }
+
+    // No handler for this topic available
+    Serial.printlnf("Topic lenght: %i", Topic->FirstLength + Topic->SecondLength);
+    Network::_printView(Topic);
     Serial.println();
 
-    Serial.printlnf("Payload lenght: %i", PayloadLength);
-    for(uint8_t i = 0x00; i < PayloadLength; i++)
-    {
-        Serial.print(Payload[i]);
-    }
+    Serial.printlnf("Payload lenght: %i", Payload->FirstLength + Payload->SecondLength);
+    Network::_printView(Payload);
 
     Serial.println();
     Serial.printlnf("QoS: %i", QoS);
@@ -64,6 +87,88 @@ void Network::_callback(uint16_t TopicLength, char* Topic, uint16_t PayloadLengt
     Serial.printlnf("DUP: %i", DUP);
 }
 
+void Network::_statusChanged(MQTT::Status Status, MQTT::Error Reason)
+{
+    if((Status == MQTT::DISCONNECTED) && ((Reason == MQTT::TIMEOUT) || (Reason == MQTT::CONNECTION_LOST)))
+    {
+        Serial.printlnf("[WARN] Lost connection to MQTT broker: %i", Reason);
+    }
+}
+
+void Network::_printView(const MQTT::View* View)
+{
+    for(uint16_t i = 0x00; i < View->FirstLength; i++)
+    {
+        Serial.print(View->First[i]);
+    }
+
+    for(uint16_t i = 0x00; i < View->SecondLength; i++)
+    {
+        Serial.print(View->Second[i]);
+    }
+}
+
+uint16_t Network::_writeDiagnostics(void)
+{
+    MQTT::Statistics Statistics;
+    JSONBufferWriter Writer(Network::_mDiagnostics, sizeof(Network::_mDiagnostics) - 0x01);
+
+    Network::_mClient.statistics(&Statistics);
+
+    Writer.beginObject();
+        Writer.name("Bytes sent").value((unsigned int)Statistics.BytesSent);
+        Writer.name("Bytes received").value((unsigned int)Statistics.BytesReceived);
+        Network::_writePackets(Writer, "Sent", Statistics.PacketsSent);
+        Network::_writePackets(Writer, "Received", Statistics.PacketsReceived);
+        Network::_writeHistogram(Writer, "Connect", &Statistics.Connect);
+        Network::_writeHistogram(Writer, "RTT", &Statistics.Publish);
+        Network::_writeHistogram(Writer, "Ping", &Statistics.Ping);
+        Writer.name("Connect timeouts").value(Statistics.ConnectTimeouts);
+        Writer.name("Ping timeouts").value(Statistics.PingTimeouts);
+        Writer.name("Retransmissions").value(Statistics.Retransmissions);
+        Writer.name("RX overflows").value(Statistics.RxOverflows);
+        Writer.name("Queue overflows").value(Statistics.QueueOverflows);
+        Writer.name("Inflight overflows").value(Statistics.InflightOverflows);
+    Writer.endObject();
+
+    // The writer stops at the end of the buffer, so the message would be invalid
+    if(Writer.dataSize() >= sizeof(Network::_mDiagnostics))
+    {
+        return 0x00;
+    }
+
+    return Writer.dataSize();
+}
+
+void Network::_writePackets(JSONBufferWriter& Writer, const char* Name, const uint16_t* Packets)
+{
+    // Only the packet types that were used are listed
+    Writer.name(Name).beginObject();
+        for(uint8_t i = 0x01; i < (sizeof(PacketNames) / sizeof(PacketNames[0])); i++)
+        {
+            if(Packets[i])
+            {
+                Writer.name(PacketNames[i]).value(Packets[i]);
+            }
+        }
+    Writer.endObject();
+}
+
+void Network::_writeHistogram(JSONBufferWriter& Writer, const char* Name, const MQTT::Histogram* Histogram)
+{
+    // Compact format: [Count, Average, Max, Bucket 0, ..., Bucket n]
+    Writer.name(Name).beginArray();
+        Writer.value((unsigned int)Histogram->Count);
+        Writer.value((unsigned int)(Histogram->Count ? (Histogram->Sum / Histogram->Count) : 0x00));
+        Writer.value((unsigned int)Histogram->Max);
+
+        for(uint8_t i = 0x00; i < MQTT_HISTOGRAM_BUCKETS; i++)
+        {
+            Writer.value(Histogram->Buckets[i]);
+        }
+    Writer.endArray();
+}
+
 void Network::_bluetoothDataReceived(const uint8_t* Data, size_t Length, const BlePeerDevice& Peer, void* Context)
 {
     if(Context == ServerUUID)
@@ -107,28 +212,121 @@ Network::Error Network::Initialize(void)
     // Configure the MQTT client
     Network::_mClient.SetBroker(Network::_mServerAddress);
     Network::_mClient.SetCallback(Network::_callback);
+    Network::_mClient.SetStatusCallback(Network::_statusChanged);
+    Network::_mDatagramClient.SetGateway(Network::_mServerAddress);
+
+    // Encode the topics for the periodic messages
+    for(uint8_t i = 0x00; i < (sizeof(Topics) / sizeof(Topics[0])); i++)
+    {
+        if(Network::_mClient.PreparePublish(&Network::_mTopics[i], Topics[i], MQTT::QOS_0, false))
+        {
+            Network::_mLastError = INVALID_PARAMETER;
+            return INVALID_PARAMETER;
+        }
+    }
 
     Network::_mLastError = NO_ERROR;
     return NO_ERROR;
 }
 
-Network::Error Network::Connect(uint32_t Timeout)
+Network::Error Network::ConnectAndPublish(uint32_t Timeout, const char* Topic, const char* Buffer, uint16_t Length)
+{
+    const MQTT::PublishMessage Message = {Topic, (const uint8_t*)Buffer, Length, false, NULL};
+
+    return Network::_connectAndPublish(Timeout, &Message);
+}
+
+Network::Error Network::ConnectAndPublish(uint32_t Timeout, Network::Topic Topic, const char* Buffer, uint16_t Length)
 {
-    if(!Network::_mClient.isConnected())
+    const MQTT::PublishMessage Message = {NULL, (const uint8_t*)Buffer, Length, false, &Network::_mTopics[Topic]};
+
+    return Network::_connectAndPublish(Timeout, &Message);
+}
+
+Network::Error Network::_connectAndPublish(uint32_t Timeout, const MQTT::PublishMessage* Message)
+{
+    uint8_t Count = 0x01;
+    MQTT::PublishMessage Messages[2];
+
+    Messages[0] = *Message;
+
+    // Append the statistics of the previous connections to the message. The statistics are kept until they are transmitted
+    if(++Network::_mCycles >= NETWORK_DIAGNOSTICS_INTERVAL)
     {
-        WiFi.on();
-        WiFi.connect();
-        if(!waitFor(WiFi.ready, Timeout))
+        uint16_t Length = Network::_writeDiagnostics();
+
+        Network::_mCycles = NETWORK_DIAGNOSTICS_INTERVAL;
+
+        // Skip the statistics when the message doesn´t fit into the buffer
+        if(Length)
         {
-            Network::_mLastError = TIMEOUT;
-            return TIMEOUT;
+            Messages[1] = {NULL, (const uint8_t*)Network::_mDiagnostics, Length, false, &Network::_mTopics[TOPIC_DIAGNOSTICS]};
+            Count++;
         }
+    }
 
-        if(Network::_mClient.Connect("SensorHub", false))
+    uint32_t Start = millis();
+    WiFi.on();
+    WiFi.connect();
+    if(!waitFor(WiFi.ready, Timeout))
+    {
+        Network::_mLastError = TIMEOUT;
+        return TIMEOUT;
+    }
+
+    // Transmit the connection request, the message and the disconnect without waiting for the broker.
+    // Failed attempts are repeated with a jittered backoff as long as the retry budget and the timeout allow it
+    for(uint8_t Attempt = 0x00; Attempt < NETWORK_RETRY_BUDGET; Attempt++)
+    {
+        MQTT::Error Error = Network::_mClient.ConnectAndPublish("SensorHub", false, Messages, Count);
+        if(Error == MQTT::NO_ERROR)
+        {
+            // Start a new interval after the statistics were transmitted
+            if(Count > 0x01)
+            {
+                Network::_mCycles = 0x00;
+                Network::_mClient.ResetStatistics();
+            }
+
+            Network::_mLastError = NO_ERROR;
+            return NO_ERROR;
+        }
+
+        // Don´t retry when the broker has refused the client
+        if((Error == MQTT::HOST_UNREACHABLE) && (Network::_mClient.connectionState() != MQTT::SERVER_UNAVAILALE))
+        {
+            break;
+        }
+
+        uint32_t Delay = MQTT::backoff(Attempt);
+        if((millis() - Start + Delay) > Timeout)
         {
-            Network::_mLastError = CONNECTION_ERROR;
-            return CONNECTION_ERROR;
+            break;
         }
+
+        delay(Delay);
+    }
+
+    Network::_mLastError = CONNECTION_ERROR;
+    return CONNECTION_ERROR;
+}
+
+Network::Error Network::PublishDatagram(uint32_t Timeout, Network::Topic Topic, const char* Buffer, uint16_t Length)
+{
+    WiFi.on();
+    WiFi.connect();
+    if(!waitFor(WiFi.ready, Timeout))
+    {
+        Network::_mLastError = TIMEOUT;
+        return TIMEOUT;
+    }
+
+    // Transmit the message as QoS -1 datagram to the MQTT-SN gateway. No handshake is needed, but the message isn´t acknowledged.
+    // NOTE: The gateway has to map the predefined topic IDs 1, 2, ... to the topics in #Topics!
+    if(Network::_mDatagramClient.Begin() || Network::_mDatagramClient.Publish(MQTTSN::PredefinedTopic(Topic + 0x01), Buffer, Length))
+    {
+        Network::_mLastError = CONNECTION_ERROR;
+        return CONNECTION_ERROR;
     }
 
     Network::_mLastError = NO_ERROR;
@@ -159,6 +357,18 @@ Network::Error Network::Publish(const char* Topic, char* Buffer, uint8_t Length)
     return NO_ERROR;
 }
 
+Network::Error Network::Register(const char* Filter, MQTT::Publish_Callback Handler)
+{
+    if(Network::_mDispatcher.Register(Filter, Handler))
+    {
+        Network::_mLastError = INVALID_PARAMETER;
+        return INVALID_PARAMETER;
+    }
+
+    Network::_mLastError = NO_ERROR;
+    return NO_ERROR;
+}
+
 Network::Error Network::Setup(uint32_t Timeout)
 {
     RGB.control(true);
@@ -27,6 +27,9 @@
 #include <application.h>
 
 #include "MQTT/mqtt.h"
+#include "MQTT/MQTTClient.h"
+#include "MQTT/MQTTDispatcher.h"
+#include "MQTT/MQTTSN.h"
 
 class Network
 {
@@ -38,19 +41,43 @@ class Network
             NO_VALID_IP = 0x02,
             CONNECTION_ERROR = 0x03,
             TIMEOUT = 0x04,
+            INVALID_PARAMETER = 0x05,
         } Error;
 
+        /** @brief MQTT client with buffers sized for the SensorHub messages.
+         *         NOTE: Only the ping timer uses the message queue, so it holds two PINGREQ packets.
+         */
+        typedef MQTTClient<64, MQTT_RX_BUFFER_SIZE, 2, MQTT_VERSION, MQTT_INFLIGHT_BUFFER_SIZE, 2, 2> Client;
+
+        /** @brief Topics of the SensorHub. The topics are prepared once with #Initialize.
+         */
+        typedef enum
+        {
+            TOPIC_WEATHER = 0x00,
+            TOPIC_ERRORS = 0x01,
+            TOPIC_DIAGNOSTICS = 0x02,
+            TOPIC_WEATHER_FRAME = 0x03,
+            TOPIC_WEATHER_CBOR = 0x04,
+            TOPIC_WEATHER_BATCH = 0x05,
+        } Topic;
+
         static Network::Error lastError(void);
 
 		static Network::Error Initialize(void);
-        static Network::Error Connect(uint32_t Timeout);
+        static Network::Error ConnectAndPublish(uint32_t Timeout, const char* Topic, const char* Buffer, uint16_t Length);
+        static Network::Error ConnectAndPublish(uint32_t Timeout, Network::Topic Topic, const char* Buffer, uint16_t Length);
+        static Network::Error PublishDatagram(uint32_t Timeout, Network::Topic Topic, const char* Buffer, uint16_t Length);
         static Network::Error Publish(const char* Topic, String Message);
         static Network::Error Publish(const char* Topic, char* Buffer, uint8_t Length);
+        static Network::Error Register(const char* Filter, MQTT::Publish_Callback Handler);
         static Network::Error Setup(uint32_t Timeout);
         static void Disconnect(void);
 
 	private:
-        static MQTT _mClient;
+        static Network::Client _mClient;
+        static MQTTSN _mDatagramClient;
+        static MQTT::PreparedPublish _mTopics[];
+        static MQTTDispatcher _mDispatcher;
         static IPAddress _mServerAddress;
 
         static Network::Error _mLastError;
@@ -58,6 +85,15 @@ class Network
         static BleCharacteristic _mServerIPCharacteristic;
         static BleAdvertisingData _mBluetoothAdvertise;
 
-        static void _callback(uint16_t TopicLength, char* Topic, uint16_t PayloadLength, char* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP);
+        static uint16_t _mCycles;
+        static char _mDiagnostics[];
+
+        static Network::Error _connectAndPublish(uint32_t Timeout, const MQTT::PublishMessage* Message);
+        static uint16_t _writeDiagnostics(void);
+        static void _writeHistogram(JSONBufferWriter& Writer, const char* Name, const MQTT::Histogram* Histogram);
+        static void _writePackets(JSONBufferWriter& Writer, const char* Name, const uint16_t* Packets);
+        static void _statusChanged(MQTT::Status Status, MQTT::Error Reason);
+        static void _callback(const MQTT::View* Topic, const MQTT::View* Payload, uint16_t ID, MQTT::QoS QoS, bool DUP);
+        static void _printView(const MQTT::View* View);
         static void _bluetoothDataReceived(const uint8_t* data, size_t len, const BlePeerDevice& peer, void* context);
 };
@@ -30,6 +30,7 @@
 
 #include "Network/Network.h"
 #include "Sensors/Sensors.h"
+#include "Telemetry/Telemetry.h"
 #include "ErrorClass/ErrorClass.h"
 
 void setup();
@@ -41,7 +42,29 @@ void loop();
 
 #define TIMEOUT                         60000
 
-char Buffer[200];
+// Default format of the weather messages
+#define TELEMETRY_FORMAT                Telemetry::FORMAT_JSON
+
+// Transmit the stored measurements as batch with every n-th wake up. 1 transmits each measurement immediately with #TELEMETRY_FORMAT
+#define TELEMETRY_BATCH_INTERVAL        5
+
+// Transmit single weather messages as QoS -1 datagrams to a MQTT-SN gateway. 0 uses a MQTT connection
+#define TELEMETRY_DATAGRAMS             0
+
+char Buffer[TELEMETRY_BATCH_SIZE];
+
+// Format of the weather messages. The format can be changed between two messages
+Telemetry::Format Format = TELEMETRY_FORMAT;
+
+// Topic for each message format
+static const Network::Topic FormatTopics[] = {Network::TOPIC_WEATHER, Network::TOPIC_WEATHER_FRAME, Network::TOPIC_WEATHER_CBOR};
+
+static_assert(Network::Client::CanPublish(sizeof("sensorhub/weather") - 1, TELEMETRY_JSON_SIZE), "Weather message doesn´t fit into the MQTT client!");
+static_assert(Network::Client::CanPublish(sizeof("sensorhub/weather/frame") - 1, TELEMETRY_FRAME_SIZE), "Weather frame doesn´t fit into the MQTT client!");
+static_assert(Network::Client::CanPublish(sizeof("sensorhub/weather/cbor") - 1, TELEMETRY_CBOR_SIZE), "Weather CBOR message doesn´t fit into the MQTT client!");
+static_assert(Network::Client::CanPublish(sizeof("sensorhub/weather/batch") - 1, sizeof(Buffer)), "Weather batch doesn´t fit into the MQTT client!");
+static_assert((TELEMETRY_JSON_SIZE + MQTTSN_PUBLISH_HEADER_SIZE) <= MQTTSN_MAX_PACKET_SIZE, "Weather message doesn´t fit into a MQTT-SN datagram!");
+static_assert((TELEMETRY_JSON_SIZE <= sizeof(Buffer)) && (TELEMETRY_FRAME_SIZE <= sizeof(Buffer)) && (TELEMETRY_CBOR_SIZE <= sizeof(Buffer)), "Buffer is too small for the weather messages!");
 
 SystemSleepConfiguration SleepConfig;
 
@@ -100,41 +123,71 @@ void loop()
 {
     System.sleep(SleepConfig);
 
-    if(Network::Connect(TIMEOUT) == Network::NO_ERROR)
+    Sensors::SensorData Data;
+
+    if(Sensors::UpdateData(&Data) == Sensors::NO_ERROR)
     {
-        Sensors::SensorData Data;
-        JSONBufferWriter Writer(Buffer, sizeof(Buffer));
+        // Report only the measurements which have left their deadband. The WiFi stays off when nothing has changed
+        uint16_t Fields = Telemetry::Changed(&Data);
 
-        if(Sensors::UpdateData(&Data) == Sensors::NO_ERROR)
+        if(TELEMETRY_BATCH_INTERVAL > 1)
         {
-            memset(Buffer, 0x00, sizeof(Buffer));
-            Writer.beginObject();
-                Writer.name("Temperature").value(Data.Temperature);
-                Writer.name("Ambient light").value(Data.AmbientLight);
-                Writer.name("UV").value(Data.UV);
-                Writer.name("Pressure").value(Data.Environment.Pressure);
-                Writer.name("Humidity").value(Data.Environment.Humidity);
-                Writer.name("Gas resistance").value(Data.Environment.GasResistance);
-                Writer.name("Gas valid").value(Data.Environment.GasValid);
-                Writer.name("IAQ").value(Data.IAQ.Value);
-                Writer.name("IAQ valid").value(Data.IAQ.Valid);
-                Writer.name("Solar").value(Data.SolarVoltage);
-                Writer.name("Battery").value(Data.BatteryVoltage);
-            Writer.endObject();
-
-            Network::Publish("sensorhub/weather", Buffer, sizeof(Buffer));
+            // The measurement is reported with the batch, so it doesn´t get lost when the transmission fails
+            Telemetry::Store(&Data, Fields);
+            Telemetry::Commit(&Data, Fields);
+
+            if(Telemetry::BatchDue(TELEMETRY_BATCH_INTERVAL))
+            {
+                uint16_t Length = Telemetry::WriteBatch((uint8_t*)Buffer, sizeof(Buffer));
+
+                if(Network::ConnectAndPublish(TIMEOUT, Network::TOPIC_WEATHER_BATCH, Buffer, Length) != Network::NO_ERROR)
+                {
+                    ErrorClass::DisplayError(ErrorClass::ERROR_NETWORK, Network::lastError());
+                }
+                else
+                {
+                    Telemetry::ClearBatch();
+                }
+            }
         }
-        else
+        else if(Fields)
         {
-            ErrorClass::DisplayError(ErrorClass::ERROR_SENSORS, Sensors::lastError());
-            String Message(Sensors::lastError());
-            Network::Publish("sensorhub/errors", Message);
-        }
+            Network::Error Error;
+
+            // Only the serialized message is transmitted. The remaining buffer isn´t part of the message
+            uint16_t Length = Telemetry::Write(Format, &Data, Fields, Buffer, sizeof(Buffer));
+
+            if(TELEMETRY_DATAGRAMS)
+            {
+                // Transmit the message without a connection. The message isn´t acknowledged by the gateway
+                Error = Network::PublishDatagram(TIMEOUT, FormatTopics[Format], Buffer, Length);
+            }
+            else
+            {
+                // Transmit the connection request and the message without waiting for the broker
+                Error = Network::ConnectAndPublish(TIMEOUT, FormatTopics[Format], Buffer, Length);
+            }
 
-        Network::Disconnect();
+            if(Error != Network::NO_ERROR)
+            {
+                ErrorClass::DisplayError(ErrorClass::ERROR_NETWORK, Network::lastError());
+            }
+            else
+            {
+                Telemetry::Commit(&Data, Fields);
+            }
+        }
     }
     else
     {
-        ErrorClass::DisplayError(ErrorClass::ERROR_NETWORK, Network::lastError());
+        ErrorClass::DisplayError(ErrorClass::ERROR_SENSORS, Sensors::lastError());
+        String Message(Sensors::lastError());
+
+        if(Network::ConnectAndPublish(TIMEOUT, Network::TOPIC_ERRORS, Message.c_str(), Message.length()) != Network::NO_ERROR)
+        {
+            ErrorClass::DisplayError(ErrorClass::ERROR_NETWORK, Network::lastError());
+        }
     }
+
+    Network::Disconnect();
 }
\ No newline at end of file
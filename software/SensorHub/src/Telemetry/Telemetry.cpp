@@ -0,0 +1,638 @@
+/*
+ * Telemetry.cpp
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Telemetry serializer for the SensorHub.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+/** @file Telemetry/Telemetry.cpp
+ *  @brief Serializer for the weather messages of the SensorHub.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include "Telemetry.h"
+
+// Force a message with all fields with every n-th wake up (1 hour with 180 s sleep)
+#define TELEMETRY_REFRESH_INTERVAL          20
+
+static const uint32_t _Powers[] = {1, 10, 100, 1000, 10000};
+
+const Telemetry::Description Telemetry::_mFields[TELEMETRY_FIELDS] = {
+    {"Temperature", TYPE_FLOAT, 2, 100.0f, -32768.0f, 32767.0f, 0x02, 0x00},
+    {"Ambient light", TYPE_FLOAT, 2, 100.0f, 0.0f, 4294967040.0f, 0x04, 0x00},
+    {"UV", TYPE_INTEGER, 0, 1.0f, 0.0f, 255.0f, 0x01, 0x00},
+    {"Pressure", TYPE_FLOAT, 2, 100.0f, 0.0f, 4294967040.0f, 0x04, 0x00},
+    {"Humidity", TYPE_FLOAT, 2, 100.0f, 0.0f, 65535.0f, 0x02, 0x00},
+    {"Gas resistance", TYPE_FLOAT, 0, 1.0f, 0.0f, 4294967040.0f, 0x04, 0x00},
+    {"Gas valid", TYPE_BOOL, 0, 0.0f, 0.0f, 0.0f, 0x00, 0x01},
+    {"IAQ", TYPE_FLOAT, 2, 100.0f, 0.0f, 65535.0f, 0x02, 0x00},
+    {"IAQ valid", TYPE_BOOL, 0, 0.0f, 0.0f, 0.0f, 0x00, 0x02},
+    {"Solar", TYPE_FLOAT, 3, 1000.0f, 0.0f, 65535.0f, 0x02, 0x00},
+    {"Battery", TYPE_FLOAT, 3, 1000.0f, 0.0f, 65535.0f, 0x02, 0x00},
+};
+
+float Telemetry::_mDeadband[TELEMETRY_FIELDS] = {0.2f, 5.0f, 0.0f, 0.5f, 1.0f, 1000.0f, 0.0f, 1.0f, 0.0f, 0.05f, 0.02f};
+float Telemetry::_mLast[TELEMETRY_FIELDS];
+
+// Start with a complete message
+uint16_t Telemetry::_mCycles = TELEMETRY_REFRESH_INTERVAL;
+
+// Keep the measurements during a reset or a sleep mode without RAM retention
+retained Telemetry::Ring Telemetry::_mRing;
+
+// Transmit the stored measurements before the ring buffer overwrites the oldest ones
+#define TELEMETRY_RING_RESERVE              2
+
+void Telemetry::SetDeadband(Telemetry::Field Field, float Deadband)
+{
+    if(Field < TELEMETRY_FIELDS)
+    {
+        Telemetry::_mDeadband[Field] = Deadband;
+    }
+}
+
+uint16_t Telemetry::Changed(const Sensors::SensorData* Data)
+{
+    uint16_t Fields = 0x00;
+
+    if(Data == NULL)
+    {
+        return 0x00;
+    }
+
+    if(++Telemetry::_mCycles >= TELEMETRY_REFRESH_INTERVAL)
+    {
+        return TELEMETRY_ALL_FIELDS;
+    }
+
+    // The values are compared with the last reported values, so a slow drift is reported when it leaves the deadband
+    for(uint8_t i = 0x00; i < TELEMETRY_FIELDS; i++)
+    {
+        float Value = Telemetry::_value(Data, (Telemetry::Field)i);
+        float Last = Telemetry::_mLast[i];
+
+        if((isnan(Value) != isnan(Last)) || (!isnan(Value) && (fabsf(Value - Last) > Telemetry::_mDeadband[i])))
+        {
+            Fields |= (0x01 << i);
+        }
+    }
+
+    return Fields;
+}
+
+void Telemetry::Commit(const Sensors::SensorData* Data, uint16_t Fields)
+{
+    if(Data == NULL)
+    {
+        return;
+    }
+
+    for(uint8_t i = 0x00; i < TELEMETRY_FIELDS; i++)
+    {
+        if(Fields & (0x01 << i))
+        {
+            Telemetry::_mLast[i] = Telemetry::_value(Data, (Telemetry::Field)i);
+        }
+    }
+
+    if((Fields & TELEMETRY_ALL_FIELDS) == TELEMETRY_ALL_FIELDS)
+    {
+        Telemetry::_mCycles = 0x00;
+    }
+}
+
+uint16_t Telemetry::Write(Telemetry::Format Format, const Sensors::SensorData* Data, uint16_t Fields, char* Buffer, uint16_t Size)
+{
+    switch(Format)
+    {
+        case FORMAT_FRAME:
+        {
+            return Telemetry::WriteFrame(Data, Fields, (uint8_t*)Buffer, Size);
+        }
+        case FORMAT_CBOR:
+        {
+            return Telemetry::WriteCBOR(Data, Fields, (uint8_t*)Buffer, Size);
+        }
+        default:
+        {
+            return Telemetry::WriteJSON(Data, Fields, Buffer, Size);
+        }
+    }
+}
+
+uint16_t Telemetry::WriteJSON(const Sensors::SensorData* Data, uint16_t Fields, char* Buffer, uint16_t Size)
+{
+    Telemetry::Writer Writer = {Buffer, Size, 0x00, false};
+
+    if((Data == NULL) || (Buffer == NULL))
+    {
+        return 0x00;
+    }
+
+    Telemetry::_writeRaw(&Writer, "{", 0x01);
+    for(uint8_t i = 0x00; i < TELEMETRY_FIELDS; i++)
+    {
+        const Telemetry::Description* Field = &Telemetry::_mFields[i];
+        float Value = Telemetry::_value(Data, (Telemetry::Field)i);
+
+        if(!(Fields & (0x01 << i)))
+        {
+            continue;
+        }
+
+        Telemetry::_writeName(&Writer, Field->Name);
+        switch(Field->Type)
+        {
+            case TYPE_BOOL:
+            {
+                Telemetry::_writeBool(&Writer, Value != 0.0f);
+                break;
+            }
+            case TYPE_INTEGER:
+            {
+                Telemetry::_writeUnsigned(&Writer, (uint32_t)Value, 0x01);
+                break;
+            }
+            default:
+            {
+                Telemetry::_writeFixed(&Writer, Value, Field->Decimals);
+                break;
+            }
+        }
+    }
+    Telemetry::_writeRaw(&Writer, "}", 0x01);
+
+    if(Writer.Overflow)
+    {
+        return 0x00;
+    }
+
+    return Writer.Length;
+}
+
+uint16_t Telemetry::WriteFrame(const Sensors::SensorData* Data, uint16_t Fields, uint8_t* Buffer, uint16_t Size)
+{
+    uint8_t Flags = 0x00;
+    uint16_t Presence = 0x00;
+    Telemetry::Writer Writer = {(char*)Buffer, Size, 0x00, false};
+
+    if((Data == NULL) || (Buffer == NULL))
+    {
+        return 0x00;
+    }
+
+    // The flags and the presence bitmap are written after the fields, so only placeholders are used here
+    Telemetry::_writeInteger(&Writer, TELEMETRY_FRAME_VERSION, 0x01);
+    Telemetry::_writeInteger(&Writer, 0x00, 0x01);
+    Telemetry::_writeInteger(&Writer, 0x00, 0x02);
+
+    for(uint8_t i = 0x00; i < TELEMETRY_FIELDS; i++)
+    {
+        const Telemetry::Description* Field = &Telemetry::_mFields[i];
+        float Value = Telemetry::_value(Data, (Telemetry::Field)i);
+
+        if(!(Fields & (0x01 << i)))
+        {
+            continue;
+        }
+
+        if(Field->Type == TYPE_BOOL)
+        {
+            if(Value != 0.0f)
+            {
+                Flags |= Field->Flag;
+            }
+
+            Presence |= (0x01 << i);
+        }
+        else if(Telemetry::_writeScaled(&Writer, Field, Value))
+        {
+            Presence |= (0x01 << i);
+        }
+    }
+
+    if(Writer.Overflow)
+    {
+        return 0x00;
+    }
+
+    Buffer[1] = Flags;
+    Buffer[2] = (Presence >> 0x08);
+    Buffer[3] = (Presence & 0xFF);
+
+    Telemetry::_writeInteger(&Writer, Telemetry::CRC16(Buffer, Writer.Length), 0x02);
+    if(Writer.Overflow)
+    {
+        return 0x00;
+    }
+
+    return Writer.Length;
+}
+
+uint16_t Telemetry::WriteCBOR(const Sensors::SensorData* Data, uint16_t Fields, uint8_t* Buffer, uint16_t Size)
+{
+    uint8_t Count = 0x00;
+    Telemetry::Writer Writer = {(char*)Buffer, Size, 0x00, false};
+
+    if((Data == NULL) || (Buffer == NULL))
+    {
+        return 0x00;
+    }
+
+    // The map has less than 24 entries, so the number of entries fits into the initial byte and can be set at the end
+    Telemetry::_writeHead(&Writer, 0x05, 0x00);
+
+    for(uint8_t i = 0x00; i < TELEMETRY_FIELDS; i++)
+    {
+        const Telemetry::Description* Field = &Telemetry::_mFields[i];
+        float Value = Telemetry::_value(Data, (Telemetry::Field)i);
+
+        if(!(Fields & (0x01 << i)) || isnan(Value))
+        {
+            continue;
+        }
+
+        Telemetry::_writeHead(&Writer, 0x00, i);
+        switch(Field->Type)
+        {
+            case TYPE_BOOL:
+            {
+                Telemetry::_writeHead(&Writer, 0x07, (Value != 0.0f) ? 21 : 20);
+                break;
+            }
+            case TYPE_INTEGER:
+            {
+                Telemetry::_writeHead(&Writer, 0x00, (uint32_t)Value);
+                break;
+            }
+            default:
+            {
+                Telemetry::_writeFloat(&Writer, Value);
+                break;
+            }
+        }
+
+        Count++;
+    }
+
+    if(Writer.Overflow)
+    {
+        return 0x00;
+    }
+
+    Buffer[0] |= Count;
+
+    return Writer.Length;
+}
+
+void Telemetry::Store(const Sensors::SensorData* Data, uint16_t Fields)
+{
+    Telemetry::_checkRing();
+
+    if(Telemetry::_mRing.Wakes < 0xFFFF)
+    {
+        Telemetry::_mRing.Wakes++;
+    }
+
+    if((Data == NULL) || !(Fields & TELEMETRY_ALL_FIELDS))
+    {
+        return;
+    }
+
+    Telemetry::Record* Record = &Telemetry::_mRing.Records[Telemetry::_mRing.Head];
+    Record->Timestamp = Time.now();
+    Record->Fields = Fields;
+    Record->Data = *Data;
+
+    Telemetry::_mRing.Head = (Telemetry::_mRing.Head + 0x01) % TELEMETRY_RING_SIZE;
+    if(Telemetry::_mRing.Count < TELEMETRY_RING_SIZE)
+    {
+        Telemetry::_mRing.Count++;
+    }
+    else
+    {
+        // The oldest record was overwritten, so its changes are missing in the following records.
+        // The new oldest record is transmitted with all fields, because each record stores a complete measurement
+        Telemetry::_mRing.Records[Telemetry::_mRing.Head].Fields = TELEMETRY_ALL_FIELDS;
+    }
+}
+
+bool Telemetry::BatchDue(uint16_t Interval)
+{
+    Telemetry::_checkRing();
+
+    if(Telemetry::_mRing.Count == 0x00)
+    {
+        return false;
+    }
+
+    return (Telemetry::_mRing.Wakes >= Interval) || (Telemetry::_mRing.Count >= (TELEMETRY_RING_SIZE - TELEMETRY_RING_RESERVE));
+}
+
+uint16_t Telemetry::WriteBatch(uint8_t* Buffer, uint16_t Size)
+{
+    Telemetry::Writer Writer = {(char*)Buffer, Size, 0x00, false};
+
+    if(Buffer == NULL)
+    {
+        return 0x00;
+    }
+
+    Telemetry::_checkRing();
+
+    Telemetry::_writeInteger(&Writer, TELEMETRY_BATCH_VERSION, 0x01);
+    Telemetry::_writeInteger(&Writer, Time.now(), 0x04);
+    Telemetry::_writeInteger(&Writer, Telemetry::_mRing.Count, 0x01);
+
+    for(uint8_t i = 0x00; i < Telemetry::_mRing.Count; i++)
+    {
+        const Telemetry::Record* Record = &Telemetry::_mRing.Records[(Telemetry::_mRing.Head + TELEMETRY_RING_SIZE - Telemetry::_mRing.Count + i) % TELEMETRY_RING_SIZE];
+
+        Telemetry::_writeInteger(&Writer, Record->Timestamp, 0x04);
+        if(Writer.Overflow || (Writer.Length >= Size))
+        {
+            return 0x00;
+        }
+
+        // The frame is written behind the length byte, so the length is set after the frame
+        uint16_t Length = Telemetry::WriteFrame(&Record->Data, Record->Fields, Buffer + Writer.Length + 0x01, Size - Writer.Length - 0x01);
+        if(Length == 0x00)
+        {
+            return 0x00;
+        }
+
+        Buffer[Writer.Length] = Length;
+        Writer.Length += Length + 0x01;
+    }
+
+    return Writer.Length;
+}
+
+void Telemetry::ClearBatch(void)
+{
+    Telemetry::_checkRing();
+
+    Telemetry::_mRing.Count = 0x00;
+    Telemetry::_mRing.Wakes = 0x00;
+}
+
+uint16_t Telemetry::CRC16(const uint8_t* Data, uint16_t Length)
+{
+    uint16_t CRC = 0xFFFF;
+
+    for(uint16_t i = 0x00; i < Length; i++)
+    {
+        CRC ^= ((uint16_t)Data[i] << 0x08);
+        for(uint8_t Bit = 0x00; Bit < 0x08; Bit++)
+        {
+            CRC = (CRC & 0x8000) ? ((CRC << 0x01) ^ 0x1021) : (CRC << 0x01);
+        }
+    }
+
+    return CRC;
+}
+
+void Telemetry::_writeRaw(Telemetry::Writer* Writer, const char* Data, uint16_t Length)
+{
+    if(Writer->Overflow || (Length > (Writer->Size - Writer->Length)))
+    {
+        Writer->Overflow = true;
+
+        return;
+    }
+
+    memcpy(Writer->Buffer + Writer->Length, Data, Length);
+    Writer->Length += Length;
+}
+
+void Telemetry::_writeName(Telemetry::Writer* Writer, const char* Name)
+{
+    // All members except the first one are separated with a comma
+    if(Writer->Length > 0x01)
+    {
+        Telemetry::_writeRaw(Writer, ",\"", 0x02);
+    }
+    else
+    {
+        Telemetry::_writeRaw(Writer, "\"", 0x01);
+    }
+
+    Telemetry::_writeRaw(Writer, Name, strlen(Name));
+    Telemetry::_writeRaw(Writer, "\":", 0x02);
+}
+
+void Telemetry::_writeUnsigned(Telemetry::Writer* Writer, uint32_t Value, uint8_t Digits)
+{
+    char Temp[10];
+    uint8_t Length = 0x00;
+
+    // Write the digits from the right. Leading zeros are added until the minimum number of digits is reached
+    do
+    {
+        Temp[sizeof(Temp) - 0x01 - Length++] = '0' + (Value % 10);
+        Value /= 10;
+    } while(Value || (Length < Digits));
+
+    Telemetry::_writeRaw(Writer, &Temp[sizeof(Temp) - Length], Length);
+}
+
+void Telemetry::_writeFixed(Telemetry::Writer* Writer, float Value, uint8_t Decimals)
+{
+    uint32_t Fixed;
+    float Scaled;
+
+    // JSON doesn´t support NaN and infinity
+    if(isnan(Value) || isinf(Value) || (Decimals >= (sizeof(_Powers) / sizeof(_Powers[0]))))
+    {
+        Telemetry::_writeRaw(Writer, "null", 0x04);
+
+        return;
+    }
+
+    // Scale the value once and round it to the last decimal place. The integer and the fractional part are
+    // calculated from the scaled integer, so the hardware FPU only needs a single multiplication
+    Scaled = ((Value < 0.0f) ? -Value : Value) * _Powers[Decimals] + 0.5f;
+    if(Scaled >= 4294967295.0f)
+    {
+        Telemetry::_writeRaw(Writer, "null", 0x04);
+
+        return;
+    }
+
+    Fixed = (uint32_t)Scaled;
+    if((Value < 0.0f) && Fixed)
+    {
+        Telemetry::_writeRaw(Writer, "-", 0x01);
+    }
+
+    Telemetry::_writeUnsigned(Writer, Fixed / _Powers[Decimals], 0x01);
+    if(Decimals)
+    {
+        Telemetry::_writeRaw(Writer, ".", 0x01);
+        Telemetry::_writeUnsigned(Writer, Fixed % _Powers[Decimals], Decimals);
+    }
+}
+
+void Telemetry::_writeBool(Telemetry::Writer* Writer, bool Value)
+{
+    if(Value)
+    {
+        Telemetry::_writeRaw(Writer, "true", 0x04);
+    }
+    else
+    {
+        Telemetry::_writeRaw(Writer, "false", 0x05);
+    }
+}
+
+void Telemetry::_writeInteger(Telemetry::Writer* Writer, uint32_t Value, uint8_t Bytes)
+{
+    char Temp[4];
+
+    for(uint8_t i = 0x00; i < Bytes; i++)
+    {
+        Temp[i] = (Value >> ((Bytes - 0x01 - i) << 0x03)) & 0xFF;
+    }
+
+    Telemetry::_writeRaw(Writer, Temp, Bytes);
+}
+
+bool Telemetry::_writeScaled(Telemetry::Writer* Writer, const Telemetry::Description* Field, float Value)
+{
+    float Scaled = roundf(Value * Field->Scale);
+
+    // NaN fails both comparisons, so invalid values are dropped together with values out of range
+    if(!((Scaled >= Field->Min) && (Scaled <= Field->Max)))
+    {
+        return false;
+    }
+
+    if(Scaled < 0.0f)
+    {
+        Telemetry::_writeInteger(Writer, (uint32_t)(int32_t)Scaled, Field->Bytes);
+    }
+    else
+    {
+        Telemetry::_writeInteger(Writer, (uint32_t)Scaled, Field->Bytes);
+    }
+
+    return true;
+}
+
+void Telemetry::_writeHead(Telemetry::Writer* Writer, uint8_t Major, uint32_t Value)
+{
+    uint8_t Head = Major << 0x05;
+
+    if(Value < 24)
+    {
+        Telemetry::_writeInteger(Writer, Head | Value, 0x01);
+    }
+    else if(Value <= 0xFF)
+    {
+        Telemetry::_writeInteger(Writer, Head | 24, 0x01);
+        Telemetry::_writeInteger(Writer, Value, 0x01);
+    }
+    else if(Value <= 0xFFFF)
+    {
+        Telemetry::_writeInteger(Writer, Head | 25, 0x01);
+        Telemetry::_writeInteger(Writer, Value, 0x02);
+    }
+    else
+    {
+        Telemetry::_writeInteger(Writer, Head | 26, 0x01);
+        Telemetry::_writeInteger(Writer, Value, 0x04);
+    }
+}
+
+void Telemetry::_writeFloat(Telemetry::Writer* Writer, float Value)
+{
+    uint32_t Bits;
+
+    memcpy(&Bits, &Value, sizeof(Bits));
+
+    // Single precision floats use the additional information 26 of the major type 7
+    Telemetry::_writeInteger(Writer, (0x07 << 0x05) | 26, 0x01);
+    Telemetry::_writeInteger(Writer, Bits, 0x04);
+}
+
+void Telemetry::_checkRing(void)
+{
+    if((Telemetry::_mRing.Magic != TELEMETRY_RING_MAGIC) || (Telemetry::_mRing.Head >= TELEMETRY_RING_SIZE) || (Telemetry::_mRing.Count > TELEMETRY_RING_SIZE))
+    {
+        memset(&Telemetry::_mRing, 0x00, sizeof(Telemetry::_mRing));
+        Telemetry::_mRing.Magic = TELEMETRY_RING_MAGIC;
+    }
+}
+
+float Telemetry::_value(const Sensors::SensorData* Data, Telemetry::Field Field)
+{
+    switch(Field)
+    {
+        case FIELD_TEMPERATURE:
+        {
+            return Data->Temperature;
+        }
+        case FIELD_AMBIENT_LIGHT:
+        {
+            return Data->AmbientLight;
+        }
+        case FIELD_UV:
+        {
+            return Data->UV;
+        }
+        case FIELD_PRESSURE:
+        {
+            return Data->Environment.Pressure;
+        }
+        case FIELD_HUMIDITY:
+        {
+            return Data->Environment.Humidity;
+        }
+        case FIELD_GAS_RESISTANCE:
+        {
+            return Data->Environment.GasResistance;
+        }
+        case FIELD_GAS_VALID:
+        {
+            return Data->Environment.GasValid ? 1.0f : 0.0f;
+        }
+        case FIELD_IAQ:
+        {
+            return Data->IAQ.Value;
+        }
+        case FIELD_IAQ_VALID:
+        {
+            return Data->IAQ.Valid ? 1.0f : 0.0f;
+        }
+        case FIELD_SOLAR:
+        {
+            return Data->SolarVoltage;
+        }
+        case FIELD_BATTERY:
+        {
+            return Data->BatteryVoltage;
+        }
+        default:
+        {
+            return NAN;
+        }
+    }
+}
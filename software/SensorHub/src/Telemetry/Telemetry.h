@@ -0,0 +1,310 @@
+/*
+ * Telemetry.h
+ *
+ *  Copyright (C) Daniel Kampert, 2020
+ *	Website: www.kampis-elektroecke.de
+ *  File info: Telemetry serializer for the SensorHub.
+
+  GNU GENERAL PUBLIC LICENSE:
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+  Errors and omissions should be reported to DanielKampert@kampis-elektroecke.de
+ */
+
+#pragma once
+
+/** @file Telemetry/Telemetry.h
+ *  @brief Serializer for the weather messages of the SensorHub. The messages are written directly into
+ *         the payload buffer, which is transmitted by the MQTT client without a copy. The serializer doesn´t
+ *         allocate memory and uses a fixed-point formatter for the measurements instead of printf.
+ *         The compact binary frame (#Telemetry::WriteFrame) has the following layout (big endian):
+ *
+ *         | Version (1) | Flags (1) | Presence bitmap (2) | Present fields ... | CRC-16 (2) |
+ *
+ *         Bit n of the presence bitmap is set when the field n of #Telemetry::Field is part of the frame.
+ *         The fields are transmitted in the order of #Telemetry::Field as scaled integers:
+ *          - Temperature:      int16, 0.01 °C
+ *          - Ambient light:    uint32, 0.01 lx
+ *          - UV:               uint8
+ *          - Pressure:         uint32, 0.01 hPa
+ *          - Humidity:         uint16, 0.01 %
+ *          - Gas resistance:   uint32, 1 Ohm
+ *          - IAQ:              uint16, 0.01 %
+ *          - Solar:            uint16, 1 mV
+ *          - Battery:          uint16, 1 mV
+ *         The validity flags don´t use any payload bytes. They are transmitted with the flags byte.
+ *         The CRC (CRC-16/CCITT-FALSE) covers all bytes of the frame before the CRC.
+ *
+ *         The CBOR message (#Telemetry::WriteCBOR) is a map with the values of #Telemetry::Field as keys.
+ *         The measurements are encoded as single precision floats, the UV index as unsigned integer
+ *         and the validity flags as simple values.
+ *
+ *         All formats can transmit a subset of the fields (report by exception). Use #Telemetry::Changed to get
+ *         the fields which have left their deadband since the last report and #Telemetry::Commit after the message
+ *         was transmitted. A message with all fields is forced periodically.
+ *
+ *         The measurements can be collected in a ring buffer in retained memory (#Telemetry::Store) and transmitted
+ *         as batch (#Telemetry::WriteBatch), so the WiFi is only used with every n-th wake up. The batch has the following layout (big endian):
+ *
+ *         | Version (1) | Time of transmission (4) | Record count (1) | Records ... |
+ *
+ *         Each record contains the time of the measurement, the length of the frame and a binary frame:
+ *
+ *         | Time of measurement (4) | Frame length (1) | Frame |
+ *
+ *         The times are read from the RTC of the device. Use the difference between both times when the RTC isn´t synchronized.
+ *
+ *  @author Daniel Kampert
+ */
+
+#include <application.h>
+
+#include "../Sensors/Sensors.h"
+
+class Telemetry
+{
+    public:
+        /** @brief Maximum length of a JSON weather message. Each measurement uses up to 10 digits (including
+         *         the decimal places), the sign and the decimal point.
+         */
+        #define TELEMETRY_JSON_SIZE                     243
+
+        /** @brief Maximum length of a binary weather frame.
+         */
+        #define TELEMETRY_FRAME_SIZE                    29
+
+        /** @brief Version of the binary frame format.
+         */
+        #define TELEMETRY_FRAME_VERSION                 0x01
+
+        /** @brief Maximum length of a CBOR weather message.
+         */
+        #define TELEMETRY_CBOR_SIZE                     56
+
+        /** @brief Number of measurements in the ring buffer.
+         */
+        #define TELEMETRY_RING_SIZE                     32
+
+        /** @brief Version of the batch format.
+         */
+        #define TELEMETRY_BATCH_VERSION                 0x01
+
+        /** @brief Maximum length of a batch with all measurements of the ring buffer.
+         */
+        #define TELEMETRY_BATCH_SIZE                    (0x06 + TELEMETRY_RING_SIZE * (0x05 + TELEMETRY_FRAME_SIZE))
+
+        /** @brief Number of fields in the weather messages.
+         */
+        #define TELEMETRY_FIELDS                        11
+
+        /** @brief Field mask with all fields of the weather messages.
+         */
+        #define TELEMETRY_ALL_FIELDS                    ((0x01 << TELEMETRY_FIELDS) - 0x01)
+
+        /** @brief Message formats for the measurements.
+         */
+        typedef enum
+        {
+            FORMAT_JSON = 0x00,							        /**< JSON object. */
+            FORMAT_FRAME = 0x01,							    /**< Binary frame. */
+            FORMAT_CBOR = 0x02,							        /**< CBOR map. */
+        } Format;
+
+        /** @brief Fields of the weather messages. The value is the bit in the field mask and in the presence bitmap of the binary frame.
+         */
+        typedef enum
+        {
+            FIELD_TEMPERATURE = 0x00,							/**< Temperature. */
+            FIELD_AMBIENT_LIGHT = 0x01,							/**< Ambient light. */
+            FIELD_UV = 0x02,							        /**< UV index. */
+            FIELD_PRESSURE = 0x03,							    /**< Pressure. */
+            FIELD_HUMIDITY = 0x04,							    /**< Humidity. */
+            FIELD_GAS_RESISTANCE = 0x05,						/**< Gas resistance. */
+            FIELD_GAS_VALID = 0x06,							    /**< Gas resistance valid flag. Transmitted as bit 0 of the flags byte. */
+            FIELD_IAQ = 0x07,							        /**< Indoor air quality. */
+            FIELD_IAQ_VALID = 0x08,							    /**< IAQ valid flag. Transmitted as bit 1 of the flags byte. */
+            FIELD_SOLAR = 0x09,							        /**< Solar voltage. */
+            FIELD_BATTERY = 0x0A,							    /**< Battery voltage. */
+        } Field;
+
+        /** @brief          Set the deadband of a field. A field is reported when the difference to the last reported value is larger than the deadband.
+         *  @param Field    Field
+         *  @param Deadband Deadband. 0 reports every change
+         */
+        static void SetDeadband(Telemetry::Field Field, float Deadband);
+
+        /** @brief      Get the fields which have left their deadband since the last report.
+         *              All fields are returned for the first message and periodically after that.
+         *              NOTE: Call this function once per measurement!
+         *  @param Data Pointer to measurements
+         *  @return     Field mask. 0 when there is nothing to report
+         */
+        static uint16_t Changed(const Sensors::SensorData* Data);
+
+        /** @brief          Mark the fields as reported. Call this function after the message was transmitted.
+         *  @param Data     Pointer to measurements
+         *  @param Fields   Field mask of the transmitted message
+         */
+        static void Commit(const Sensors::SensorData* Data, uint16_t Fields);
+
+        /** @brief          Serialize the measurements.
+         *  @param Format   Message format
+         *  @param Data     Pointer to measurements
+         *  @param Fields   Field mask with the fields of the message (i. e. #TELEMETRY_ALL_FIELDS)
+         *  @param Buffer   Pointer to payload buffer
+         *  @param Size     Size of the payload buffer
+         *  @return         Length of the message. 0 when the message doesn´t fit into the buffer
+         */
+        static uint16_t Write(Telemetry::Format Format, const Sensors::SensorData* Data, uint16_t Fields, char* Buffer, uint16_t Size);
+
+        /** @brief          Serialize the measurements as JSON object.
+         *  @param Data     Pointer to measurements
+         *  @param Fields   Field mask with the fields of the message
+         *  @param Buffer   Pointer to payload buffer
+         *  @param Size     Size of the payload buffer
+         *  @return         Length of the message without a terminator. 0 when the message doesn´t fit into the buffer
+         *                  NOTE: Measurements which aren´t a number are written as null!
+         */
+        static uint16_t WriteJSON(const Sensors::SensorData* Data, uint16_t Fields, char* Buffer, uint16_t Size);
+
+        /** @brief          Serialize the measurements as binary frame.
+         *  @param Data     Pointer to measurements
+         *  @param Fields   Field mask with the fields of the message
+         *  @param Buffer   Pointer to payload buffer
+         *  @param Size     Size of the payload buffer
+         *  @return         Length of the frame. 0 when the frame doesn´t fit into the buffer
+         *                  NOTE: Measurements which aren´t a number or which are out of the range of the field aren´t transmitted!
+         */
+        static uint16_t WriteFrame(const Sensors::SensorData* Data, uint16_t Fields, uint8_t* Buffer, uint16_t Size);
+
+        /** @brief          Serialize the measurements as CBOR map (RFC 7049).
+         *  @param Data     Pointer to measurements
+         *  @param Fields   Field mask with the fields of the message
+         *  @param Buffer   Pointer to payload buffer
+         *  @param Size     Size of the payload buffer
+         *  @return         Length of the message. 0 when the message doesn´t fit into the buffer
+         *                  NOTE: Measurements which aren´t a number aren´t part of the map!
+         */
+        static uint16_t WriteCBOR(const Sensors::SensorData* Data, uint16_t Fields, uint8_t* Buffer, uint16_t Size);
+
+        /** @brief          Store a measurement in the ring buffer. The oldest measurement is overwritten when the buffer is full.
+         *                  The following measurement is transmitted with all fields afterwards, so no change gets lost.
+         *                  NOTE: Call this function with each wake up, even when there is nothing to report!
+         *  @param Data     Pointer to measurements
+         *  @param Fields   Field mask with the fields of the measurement. 0 only counts the wake up
+         */
+        static void Store(const Sensors::SensorData* Data, uint16_t Fields);
+
+        /** @brief          Check if the stored measurements should be transmitted.
+         *  @param Interval Number of wake ups between two transmissions
+         *  @return         #true when the interval is over or the ring buffer is nearly full
+         *                  NOTE: An empty ring buffer is never transmitted!
+         */
+        static bool BatchDue(uint16_t Interval);
+
+        /** @brief          Serialize all stored measurements as batch. The oldest measurement is the first record.
+         *  @param Buffer   Pointer to payload buffer
+         *  @param Size     Size of the payload buffer
+         *  @return         Length of the batch. 0 when the batch doesn´t fit into the buffer
+         */
+        static uint16_t WriteBatch(uint8_t* Buffer, uint16_t Size);
+
+        /** @brief Remove all stored measurements. Call this function after the batch was transmitted.
+         */
+        static void ClearBatch(void);
+
+        /** @brief          Calculate the CRC-16/CCITT-FALSE of a frame.
+         *  @param Data     Pointer to data
+         *  @param Length   Length of the data
+         *  @return         CRC
+         */
+        static uint16_t CRC16(const uint8_t* Data, uint16_t Length);
+
+    private:
+        /** @brief Encoding of a field.
+         */
+        typedef enum
+        {
+            TYPE_FLOAT = 0x00,							        /**< Measurement. */
+            TYPE_INTEGER = 0x01,							    /**< Unsigned integer. */
+            TYPE_BOOL = 0x02,							        /**< Flag. */
+        } Type;
+
+        /** @brief Description of a field.
+         */
+        typedef struct
+        {
+            const char* Name;							        /**< Name in the JSON object. */
+            Telemetry::Type Type;							    /**< Encoding of the field. */
+            uint8_t Decimals;							        /**< Decimal places in the JSON object. */
+            float Scale;							            /**< Scale for the integer in the binary frame. */
+            float Min;							                /**< Minimum of the scaled integer. */
+            float Max;							                /**< Maximum of the scaled integer. */
+            uint8_t Bytes;							            /**< Size of the scaled integer in the binary frame. */
+            uint8_t Flag;							            /**< Bit in the flags byte of the binary frame. Only used for flags. */
+        } Description;
+
+        /** @brief Marker for a valid ring buffer. Retained memory contains random data after a power loss.
+         */
+        #define TELEMETRY_RING_MAGIC                    0x54524731
+
+        /** @brief Stored measurement.
+         */
+        typedef struct
+        {
+            uint32_t Timestamp;							        /**< Time of the measurement. */
+            uint16_t Fields;							        /**< Field mask of the measurement. */
+            Sensors::SensorData Data;							/**< Measurements. */
+        } Record;
+
+        /** @brief Ring buffer with the stored measurements.
+         */
+        typedef struct
+        {
+            uint32_t Magic;							            /**< #TELEMETRY_RING_MAGIC when the ring buffer is valid. */
+            uint8_t Head;							            /**< Index of the next record. */
+            uint8_t Count;							            /**< Number of stored records. */
+            uint16_t Wakes;							            /**< Number of wake ups since the last transmission. */
+            Telemetry::Record Records[TELEMETRY_RING_SIZE];		/**< Records. */
+        } Ring;
+
+        /** @brief Output cursor of the serializer.
+         */
+        typedef struct
+        {
+            char* Buffer;							            /**< Pointer to payload buffer. */
+            uint16_t Size;							            /**< Size of the payload buffer. */
+            uint16_t Length;							        /**< Number of written bytes. */
+            bool Overflow;							            /**< Set when the message doesn´t fit into the buffer. */
+        } Writer;
+
+        static const Telemetry::Description _mFields[TELEMETRY_FIELDS];
+        static float _mDeadband[TELEMETRY_FIELDS];
+        static float _mLast[TELEMETRY_FIELDS];
+        static uint16_t _mCycles;
+        static Telemetry::Ring _mRing;
+
+        static void _checkRing(void);
+
+        static float _value(const Sensors::SensorData* Data, Telemetry::Field Field);
+        static void _writeRaw(Telemetry::Writer* Writer, const char* Data, uint16_t Length);
+        static void _writeName(Telemetry::Writer* Writer, const char* Name);
+        static void _writeUnsigned(Telemetry::Writer* Writer, uint32_t Value, uint8_t Digits);
+        static void _writeFixed(Telemetry::Writer* Writer, float Value, uint8_t Decimals);
+        static void _writeBool(Telemetry::Writer* Writer, bool Value);
+        static void _writeInteger(Telemetry::Writer* Writer, uint32_t Value, uint8_t Bytes);
+        static void _writeHead(Telemetry::Writer* Writer, uint8_t Major, uint32_t Value);
+        static void _writeFloat(Telemetry::Writer* Writer, float Value);
+        static bool _writeScaled(Telemetry::Writer* Writer, const Telemetry::Description* Field, float Value);
+};